@@ -75,6 +75,49 @@ function Files(inclusions, exclusions, callback)
 	table.insert(MBuild.currentProject.files, MBuild.Files:new(inclusions, exclusions, callback));
 end
 
+-- At the project layer inputs are the files the command processes, at the files layer it processes every matched file
+-- and inputs are extra dependencies like the generator itself. Outputs using ${input} are produced per input.
+function CustomCommand(settings)
+	local cur;
+	if MBuild.currentLayer == MBuild.projectLayer then
+		cur = MBuild.currentProject;
+	elseif MBuild.currentLayer == MBuild.filesLayer then
+		cur = MBuild.currentFiles;
+	else
+		error("CustomCommand() has to be invoked inside a project or files!");
+	end
+
+	if type(settings) ~= "table" then
+		error("CustomCommand() requires a table of settings!");
+	end
+	if type(settings.command) ~= "string" then
+		error("CustomCommand() requires command to be a string!");
+	end
+	for _, key in ipairs({ "inputs", "outputs" }) do
+		if type(settings[key]) == "string" then
+			settings[key] = { settings[key] };
+		elseif settings[key] ~= nil and type(settings[key]) ~= "table" then
+			error(string.format("CustomCommand() requires %s to be either a string or an array of strings!", key));
+		end
+		for _, v in ipairs(settings[key] or {}) do
+			if type(v) ~= "string" then
+				error(string.format("CustomCommand() requires %s to be either a string or an array of strings!", key));
+			end
+		end
+	end
+	if not settings.outputs or #settings.outputs == 0 then
+		error("CustomCommand() requires at least one output!");
+	end
+	if settings.batch ~= nil and (type(settings.batch) ~= "number" or settings.batch < 1 or settings.batch ~= math.floor(settings.batch)) then
+		error("CustomCommand() requires batch to be a positive integer!");
+	end
+	if settings.description ~= nil and type(settings.description) ~= "string" then
+		error("CustomCommand() requires description to be a string!");
+	end
+
+	table.insert(cur.customCommands, MBuild.CustomCommand:new(settings));
+end
+
 function Location(path)
 	local cur;
 	if MBuild.currentLayer == MBuild.workspaceLayer then
@@ -148,264 +191,211 @@ end
 
 local Configs = MBuild.Configs;
 
-Configs.RegisterHandler({
-	name     = "bool",
-	callback = function(settings, value)
-		if type(value) ~= "boolean" then
-			error(string.format("'%s' requires boolean parameter, got '%s'", settings.name, type(value)));
-		end
-		MBuild.currentConfigs[settings.key] = value;
-	end,
-	evaluate = function(settings, value)
+-- LuaJIT has no math.tointeger, numbers are doubles
+local function ToInteger(value)
+	if value == math.floor(value) then
 		return value;
 	end
-});
-Configs.RegisterHandler({
-	name     = "number",
-	callback = function(settings, value)
-		if type(value) ~= "number" then
-			error(string.format("'%s' requires number parameter, got '%s'", settings.name, type(value)));
-		end
-		if not Configs.TestValid(value, settings.valid) then
-			error(string.format("'%s' requires a valid number, got '%s', valid values are: [ %s ]", settings.name, tostring(value), Configs.ValidValuesToString(settings.valid)));
-		end
-		MBuild.currentConfigs[settings.key] = value;
-	end,
-	evaluate = function(settings, value)
-		return value;
-	end
-});
-Configs.RegisterHandler({
-	name     = "int",
-	callback = function(settings, value)
-		if type(value) ~= "number" then
-			error(string.format("'%s' requires integer parameter, got '%s'", settings.name, type(value)));
-		end
-		value = math.tointeger(value);
-		if not value then
-			error(string.format("'%s' requires integer parameter, got 'double'", settings.name));
-		end
-		if not Configs.TestValid(value, settings.valid) then
-			error(string.format("'%s' requires a valid integer, got '%s', valid values are: [ %s ]", settings.name, tostring(value), Configs.ValidValuesToString(settings.valid)));
-		end
-		MBuild.currentConfigs[settings.key] = value;
-	end,
-	evaluate = function(settings, value)
-		return value;
-	end
-});
-Configs.RegisterHandler({
-	name     = "string",
-	callback = function(settings, value)
-		if type(value) ~= "string" then
-			error(string.format("'%s' requires string parameter, got '%s'", settings.name, type(value)));
-		end
-		if not Configs.TestValid(value, settings.valid) then
-			error(string.format("'%s' requires a valid string, got '%s', valid values are: [ %s ]", settings.name, tostring(value), Configs.ValidValuesToString(settings.valid)));
-		end
-		MBuild.currentConfigs[settings.key] = value;
-	end,
-	evaluate = function(settings, value)
-		if settings.transform then
-			return MBuild:TransformString(value);
-		else
-			return value;
+	return nil;
+end
+
+local function InvalidValue(settings, format, value)
+	error(string.format(format, settings.name, tostring(value), Configs.ValidValuesToString(settings.valid)));
+end
+
+-- Compiles the setter of a single value config, errors = { type, integer, valid } format strings
+local function CompileValue(settings, valueType, integer, errors)
+	local key      = settings.key;
+	local validSet = settings.validSet;
+	return function(value)
+		if type(value) ~= valueType then
+			error(string.format(errors.type, settings.name, type(value)));
 		end
-	end
-});
-Configs.RegisterHandler({
-	name     = "path",
-	callback = function(settings, value)
-		if type(value) ~= "string" then
-			error(string.format("'%s' requires string parameter, got '%s'", settings.name, type(value)));
+		if integer and not ToInteger(value) then
+			error(string.format(errors.integer, settings.name));
 		end
-		if not Configs.TestValid(value, settings.valid) then
-			error(string.format("'%s' requires a valid path, got '%s', valid values are: [ %s ]", settings.name, tostring(value), Configs.ValidValuesToString(settings.valid)));
+		if settings.min and value < settings.min then
+			error(string.format(errors.min, settings.name, settings.min, value));
 		end
-		MBuild.currentConfigs[settings.key] = value;
-	end,
-	evaluate = function(settings, value)
-		if settings.transform then
-			return fs.absolute(MBuild:TransformString(value));
-		else
-			return fs.absolute(value);
+		if validSet and not validSet[value] then
+			InvalidValue(settings, errors.valid, value);
 		end
-	end
-});
+		MBuild.currentConfigs[key] = value;
+	end;
+end
 
-Configs.RegisterHandler({
-	name     = "bool[]",
-	callback = function(settings, value)
+-- Compiles the setter of an array config, every element is checked before anything is stored, so a bad element doesn't leave a partial append behind.
+-- Appends go straight into the existing array of the current layer.
+local function CompileArray(settings, valueType, integer, errors)
+	local key      = settings.key;
+	local validSet = settings.validSet;
+	local append   = settings.append;
+	return function(value)
 		if type(value) ~= "table" then
-			if type(value) ~= "boolean" then
-				error(string.format("'%s' requires a boolean or an array of boolean parameters got '%s'", settings.name, type(value)));
+			if type(value) ~= valueType then
+				error(string.format(errors.type, settings.name, type(value)));
 			end
 			value = { value };
 		end
 		for k, v in pairs(value) do
-			if type(v) ~= "boolean" then
-				error(string.format("'%s' requires a boolean or an array of boolean parameters got '%s'='%s'", settings.name, tostring(k), type(v)));
+			if type(v) ~= valueType then
+				error(string.format(errors.element, settings.name, tostring(k), type(v)));
 			end
-		end
-		if settings.append then
-			MBuild.currentConfigs[settings.key] = MBuild.currentConfigs[settings.key] or {};
-			
-			local arr = MBuild.currentConfigs[settings.key];
-			for k, v in pairs(value) do
-				table.insert(arr, v);
+			if integer and not ToInteger(v) then
+				error(string.format(errors.element, settings.name, tostring(k), "double"));
 			end
-		else
-			MBuild.currentConfigs[settings.key] = value;
-		end
-	end,
-	evaluate = function(settings, value)
-		return value;
-	end
-});
-Configs.RegisterHandler({
-	name     = "number[]",
-	callback = function(settings, value)
-		if type(value) ~= "table" then
-			if type(value) ~= "number" then
-				error(string.format("'%s' requires a number or an array of number parameters got '%s'", settings.name, type(value)));
+			if validSet and not validSet[v] then
+				InvalidValue(settings, errors.valid, v);
 			end
-			value = { value };
 		end
-		for k, v in pairs(value) do
-			if type(v) ~= "number" then
-				error(string.format("'%s' requires a number or an array of number parameters got '%s'='%s'", settings.name, tostring(k), type(v)));
-			end
-			if not Configs.TestValid(v, settings.valid) then
-				error(string.format("'%s' requires valid numbers, got '%s', valid values are: [ %s ]", settings.name, tostring(v), Configs.ValidValuesToString(settings.valid)));
+
+		if append then
+			local arr = MBuild.currentConfigs[key];
+			if not arr then
+				arr                        = {};
+				MBuild.currentConfigs[key] = arr;
 			end
-		end
-		if settings.append then
-			MBuild.currentConfigs[settings.key] = MBuild.currentConfigs[settings.key] or {};
-			
-			local arr = MBuild.currentConfigs[settings.key];
-			for k, v in pairs(value) do
-				table.insert(arr, v);
+			local n = #arr;
+			for i = 1, #value do
+				arr[n + i] = value[i];
 			end
 		else
-			MBuild.currentConfigs[settings.key] = value;
+			MBuild.currentConfigs[key] = value;
 		end
-	end,
-	evaluate = function(settings, value)
-		return value;
+	end;
+end
+
+-- Arrays are shared between every config of a map, so elements are transformed into a new array, arrays without any ${} are returned as is
+local function CompileArrayTransform(settings)
+	if not settings.transform then
+		return nil;
 	end
-});
-Configs.RegisterHandler({
-	name     = "int[]",
-	callback = function(settings, value)
-		if type(value) ~= "table" then
-			if type(value) ~= "number" then
-				error(string.format("'%s' requires an integer or an array of integer parameters got '%s'", settings.name, type(value)));
-			end
-			value = math.tointeger(value);
-			if not value then
-				error(string.format("'%s' requires an integer or an array of integer parameters got 'double'", settings.name));
-			end
-			value = { value };
-		end
-		for k, v in pairs(value) do
-			if type(v) ~= "number" then
-				error(string.format("'%s' requires an integer or an array of integer parameters got '%s'='%s'", settings.name, tostring(k), type(v)));
-			end
-			if not Configs.TestValid(v, settings.valid) then
-				error(string.format("'%s' requires valid integers, got '%s', valid values are: [ %s ]", settings.name, tostring(v), Configs.ValidValuesToString(settings.valid)));
-			end
-		end
-		if settings.append then
-			MBuild.currentConfigs[settings.key] = MBuild.currentConfigs[settings.key] or {};
-			
-			local arr = MBuild.currentConfigs[settings.key];
-			for k, v in pairs(value) do
-				v = math.tointeger(v);
-				if not v then
-					error(string.format("'%s' requires an integer or an array of integer parameters got '%s'='double'", settings.name, tostring(k)));
+	return function(value)
+		local transformed;
+		for i = 1, #value do
+			local v = value[i];
+			if not transformed and v:find("${", 1, true) then
+				transformed = {};
+				for j = 1, i - 1 do
+					transformed[j] = value[j];
 				end
-				table.insert(arr, v);
 			end
-		else
-			MBuild.currentConfigs[settings.key] = value;
+			if transformed then
+				transformed[i] = MBuild:TransformString(v);
+			end
 		end
-	end,
-	evaluate = function(settings, value)
-		return value;
+		return transformed or value;
+	end;
+end
+
+Configs.RegisterHandler({
+	name    = "bool",
+	compile = function(settings)
+		return CompileValue(settings, "boolean", false, {
+			type = "'%s' requires boolean parameter, got '%s'"
+		}), nil;
 	end
 });
 Configs.RegisterHandler({
-	name     = "string[]",
-	callback = function(settings, value)
-		if type(value) ~= "table" then
-			if type(value) ~= "string" then
-				error(string.format("'%s' requires a string or an array of string parameters got '%s'", settings.name, type(value)));
-			end
-			value = { value };
-		end
-		for k, v in pairs(value) do
-			if type(v) ~= "string" then
-				error(string.format("'%s' requires a string or an array of string parameters got '%s'='%s'", settings.name, tostring(k), type(v)));
-			end
-			if not Configs.TestValid(v, settings.valid) then
-				error(string.format("'%s' requires valid strings, got '%s', valid values are: [ %s ]", settings.name, tostring(v), Configs.ValidValuesToString(settings.valid)));
-			end
-		end
-		if settings.append then
-			MBuild.currentConfigs[settings.key] = MBuild.currentConfigs[settings.key] or {};
-			
-			local arr = MBuild.currentConfigs[settings.key];
-			for k, v in pairs(value) do
-				table.insert(arr, v);
-			end
-		else
-			MBuild.currentConfigs[settings.key] = value;
-		end
-	end,
-	evaluate = function(settings, value)
-		if settings.transform then
-			for k, v in ipairs(value) do
-				value[k] = MBuild:TransformString(v);
-			end
-		end
-		return value;
+	name    = "number",
+	compile = function(settings)
+		return CompileValue(settings, "number", false, {
+			type  = "'%s' requires number parameter, got '%s'",
+			valid = "'%s' requires a valid number, got '%s', valid values are: [ %s ]"
+		}), nil;
 	end
 });
 Configs.RegisterHandler({
-	name     = "path[]",
-	callback = function(settings, value)
-		if type(value) ~= "table" then
-			if type(value) ~= "string" then
-				error(string.format("'%s' requires a string or an array of string parameters got '%s'", settings.name, type(value)));
-			end
-			value = { value };
-		end
-		for k, v in pairs(value) do
-			if type(v) ~= "string" then
-				error(string.format("'%s' requires a string or an array of string parameters got '%s'='%s'", settings.name, tostring(k), type(v)));
-			end
-			if not Configs.TestValid(v, settings.valid) then
-				error(string.format("'%s' requires valid paths, got '%s', valid values are: [ %s ]", settings.name, tostring(v), Configs.ValidValuesToString(settings.valid)));
-			end
-		end
-		if settings.append then
-			MBuild.currentConfigs[settings.key] = MBuild.currentConfigs[settings.key] or {};
-			
-			local arr = MBuild.currentConfigs[settings.key];
-			for k, v in pairs(value) do
-				table.insert(arr, v);
-			end
-		else
-			MBuild.currentConfigs[settings.key] = value;
-		end
-	end,
-	evaluate = function(settings, value)
-		if settings.transform then
-			for k, v in ipairs(value) do
-				value[k] = MBuild:TransformString(v);
-			end
-		end
-		return value;
+	name    = "int",
+	compile = function(settings)
+		return CompileValue(settings, "number", true, {
+			type    = "'%s' requires integer parameter, got '%s'",
+			integer = "'%s' requires integer parameter, got 'double'",
+			min     = "'%s' requires an integer of at least %d, got '%d'",
+			valid   = "'%s' requires a valid integer, got '%s', valid values are: [ %s ]"
+		}), nil;
+	end
+});
+Configs.RegisterHandler({
+	name    = "string",
+	compile = function(settings)
+		local setter = CompileValue(settings, "string", false, {
+			type  = "'%s' requires string parameter, got '%s'",
+			valid = "'%s' requires a valid string, got '%s', valid values are: [ %s ]"
+		});
+		if not settings.transform then
+			return setter, nil;
+		end
+		return setter, function(value)
+			return MBuild:TransformString(value);
+		end;
+	end
+});
+Configs.RegisterHandler({
+	name    = "path",
+	compile = function(settings)
+		local setter = CompileValue(settings, "string", false, {
+			type  = "'%s' requires string parameter, got '%s'",
+			valid = "'%s' requires a valid path, got '%s', valid values are: [ %s ]"
+		});
+		if not settings.transform then
+			return setter, function(value)
+				return fs.normalize(fs.absolute(value));
+			end;
+		end
+		return setter, function(value)
+			return fs.normalize(fs.absolute(MBuild:TransformString(value)));
+		end;
+	end
+});
+
+Configs.RegisterHandler({
+	name    = "bool[]",
+	compile = function(settings)
+		return CompileArray(settings, "boolean", false, {
+			type    = "'%s' requires a boolean or an array of boolean parameters got '%s'",
+			element = "'%s' requires a boolean or an array of boolean parameters got '%s'='%s'"
+		}), nil;
+	end
+});
+Configs.RegisterHandler({
+	name    = "number[]",
+	compile = function(settings)
+		return CompileArray(settings, "number", false, {
+			type    = "'%s' requires a number or an array of number parameters got '%s'",
+			element = "'%s' requires a number or an array of number parameters got '%s'='%s'",
+			valid   = "'%s' requires valid numbers, got '%s', valid values are: [ %s ]"
+		}), nil;
+	end
+});
+Configs.RegisterHandler({
+	name    = "int[]",
+	compile = function(settings)
+		return CompileArray(settings, "number", true, {
+			type    = "'%s' requires an integer or an array of integer parameters got '%s'",
+			element = "'%s' requires an integer or an array of integer parameters got '%s'='%s'",
+			valid   = "'%s' requires valid integers, got '%s', valid values are: [ %s ]"
+		}), nil;
+	end
+});
+Configs.RegisterHandler({
+	name    = "string[]",
+	compile = function(settings)
+		return CompileArray(settings, "string", false, {
+			type    = "'%s' requires a string or an array of string parameters got '%s'",
+			element = "'%s' requires a string or an array of string parameters got '%s'='%s'",
+			valid   = "'%s' requires valid strings, got '%s', valid values are: [ %s ]"
+		}), CompileArrayTransform(settings);
+	end
+});
+Configs.RegisterHandler({
+	name    = "path[]",
+	compile = function(settings)
+		return CompileArray(settings, "string", false, {
+			type    = "'%s' requires a string or an array of string parameters got '%s'",
+			element = "'%s' requires a string or an array of string parameters got '%s'='%s'",
+			valid   = "'%s' requires valid paths, got '%s', valid values are: [ %s ]"
+		}), CompileArrayTransform(settings);
 	end
 });
 
@@ -437,7 +427,7 @@ Configs.RegisterConfig({
 	type  = "string",
 	name  = "Kind",
 	key   = "kind",
-	valid = { "ConsoleApp", "WindowedApp" }
+	valid = { "ConsoleApp", "WindowedApp", "StaticLib", "Test" }
 });
 Configs.RegisterConfig({
 	type      = "path[]",
@@ -445,4 +435,77 @@ Configs.RegisterConfig({
 	key       = "includeDirs",
 	append    = true,
 	transform = true
+});
+Configs.RegisterConfig({
+	type  = "string",
+	name  = "Compiler",
+	key   = "compiler",
+	valid = { "GNU/gcc", "LLVM/clang", "MSVC/CL" }
+});
+Configs.RegisterConfig({
+	type  = "bool",
+	name  = "UnityBuild",
+	key   = "unityBuild"
+});
+Configs.RegisterConfig({
+	type  = "int",
+	name  = "UnityBatchSize",
+	key   = "unityBatchSize",
+	min   = 1
+});
+Configs.RegisterConfig({
+	type      = "path",
+	name      = "PCHHeader",
+	key       = "pchHeader",
+	transform = true
+});
+Configs.RegisterConfig({
+	type      = "path",
+	name      = "PCHSource",
+	key       = "pchSource",
+	transform = true
+});
+Configs.RegisterConfig({
+	type   = "string[]",
+	name   = "Links",
+	key    = "links",
+	append = true
+});
+Configs.RegisterConfig({
+	type  = "string",
+	name  = "Linker",
+	key   = "linker",
+	valid = { "Default", "Auto", "BFD", "Gold", "LLD", "Mold" }
+});
+Configs.RegisterConfig({
+	type = "bool",
+	name = "SplitDwarf",
+	key  = "splitDwarf"
+});
+Configs.RegisterConfig({
+	type = "bool",
+	name = "GdbIndex",
+	key  = "gdbIndex"
+});
+Configs.RegisterConfig({
+	type = "bool",
+	name = "Modules",
+	key  = "modules"
+});
+Configs.RegisterConfig({
+	type  = "string",
+	name  = "Package",
+	key   = "package",
+	valid = { "Off", "Tar", "TarZstd" }
+});
+Configs.RegisterConfig({
+	type  = "string",
+	name  = "TestFramework",
+	key   = "testFramework",
+	valid = { "None", "GTest" }
+});
+Configs.RegisterConfig({
+	type  = "int",
+	name  = "TestShards",
+	key   = "testShards"
 });
\ No newline at end of file
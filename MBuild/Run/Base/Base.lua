@@ -8,6 +8,10 @@ MBuild = MBuild or {
 	currentFiles     = nil,
 	currentWhen      = nil,
 	currentLayer     = 0,
+	options          = {},
+	arguments        = {},
+	finishCallbacks  = {},
+	commands         = {},
 	-- Layer Enumerations:
 	globalLayer    = 0,
 	workspaceLayer = 1,
@@ -16,42 +20,188 @@ MBuild = MBuild or {
 	filesLayer     = 4
 };
 
-function MBuild.ShallowCopy(orig)
-	if type(orig) == "table" then
-		local copy = {};
-		for k, v in pairs(orig) do
-			copy[k] = v;
+-- Both copies are created with their final size and keep the metatable of the original, DeepCopy preserves cycles and shared tables
+MBuild.ShallowCopy = table.shallow_copy;
+MBuild.DeepCopy    = table.deep_copy;
+MBuild.Merge       = table.merge;
+
+-- Only touches the file when its content changed, so anything depending on its mtime stays up to date.
+-- The comparison and the atomic replace happen in fs.write_if_changed, content may also be a buffer from fs.read
+function MBuild.WriteFileIfChanged(path, content)
+	local suc, changed = fs.write_if_changed(path, content);
+	if not suc then
+		error(changed);
+	end
+	return changed;
+end
+
+-- Returns the content of a file as a string, or nil when it can't be read
+function MBuild.ReadFile(path)
+	local suc, buffer = fs.read(path);
+	if not suc then
+		return nil;
+	end
+	local content = buffer:string();
+	buffer:close();
+	return content;
+end
+
+-- Quotes argument for the shell commands run by Execute() and written into build files
+function MBuild.ShellQuote(argument)
+	if argument:find("^[%w%-_%./=:+,@%%]+$") then
+		return argument;
+	end
+	if os.host() == "windows" then
+		return "\"" .. argument:gsub("\"", "\\\"") .. "\"";
+	end
+	return "'" .. argument:gsub("'", "'\\''") .. "'";
+end
+
+-- Runs command through the shell and returns its exit code.
+-- Plain LuaJIT returns the raw wait status of system(), with LUAJIT_ENABLE_LUA52COMPAT it returns ok, "exit"|"signal", code
+function MBuild.Execute(command)
+	local ok, how, code = os.execute(command);
+	if type(ok) == "number" then
+		if os.host() ~= "windows" and ok > 255 then
+			return math.floor(ok / 256);
 		end
-		setmetatable(copy, getmetatable(orig));
-		return copy;
-	else
-		return orig;
+		return ok;
+	end
+	if how == "signal" then
+		return 128 + (code or 0);
 	end
+	return code or (ok and 0 or 1);
 end
 
-function MBuild.DeepCopy(orig, copies)
-	copies = copies or {};
-	if type(orig) == "table" then
-		if copies[orig] then
-			return copies[orig];
+local function SerializeValue(value, indent)
+	local vtype = type(value);
+	if vtype == "string" then
+		return string.format("%q", value);
+	elseif vtype == "number" then
+		-- tostring() only keeps 14 digits, which isn't enough for timestamps
+		if value == math.floor(value) and math.abs(value) < 2 ^ 53 then
+			return string.format("%d", value);
+		end
+		return string.format("%.17g", value);
+	elseif vtype == "boolean" then
+		return tostring(value);
+	elseif vtype == "cdata" and tostring(value):match("^%-?%d+U?LL$") then
+		-- 64 bit integers like fs.mtime_ns times, the LL literal loads as the same boxed integer
+		return tostring(value);
+	elseif vtype ~= "table" then
+		error(string.format("Serialize() can't serialize '%s'", vtype));
+	end
+
+	local keys = {};
+	for k, _ in pairs(value) do
+		table.insert(keys, k);
+	end
+	table.sort(keys, function(a, b)
+		if type(a) == type(b) then
+			return a < b;
+		end
+		return type(a) == "number";
+	end);
+
+	local innerIndent = indent .. "\t";
+	local entries     = {};
+	for _, k in ipairs(keys) do
+		local key;
+		if type(k) == "string" and k:match("^[%a_][%w_]*$") then
+			key = k;
 		else
-			local copy   = {};
-			copies[orig] = copy;
-			for key, value in next, orig, nil do
-				copy[self.DeepCopy(key, copies)] = self.DeepCopy(value, copies);
-			end
-			setmetatable(copy, self.DeepCopy(getmetatable(orig), copies));
-			return copy;
+			key = "[" .. SerializeValue(k, innerIndent) .. "]";
 		end
-	else
-		return orig;
+		table.insert(entries, string.format("%s%s = %s", innerIndent, key, SerializeValue(value[k], innerIndent)));
+	end
+	if #entries == 0 then
+		return "{}";
 	end
+	return "{\n" .. table.concat(entries, ",\n") .. "\n" .. indent .. "}";
+end
+
+-- Serializes plain data with sorted keys, so equal tables always produce the same text
+function MBuild.Serialize(value)
+	return "return " .. SerializeValue(value, "") .. ";\n";
+end
+
+function MBuild.Deserialize(path)
+	local chunk = loadfile(path);
+	if not chunk then
+		return nil;
+	end
+	setfenv(chunk, {});
+	local suc, res = pcall(chunk);
+	if suc then
+		return res;
+	end
+	return nil;
+end
+
+function MBuild.CacheDir()
+	return fs.normalize(fs.append(fs.current_path(), ".mbuild"));
+end
+
+-- "--name=value" and "--name" become options, everything else is kept in order as arguments.
+-- A lone "--" ends the options, everything after it is an argument even when it starts with "--"
+function MBuild.ParseArguments(args)
+	local options   = {};
+	local arguments = {};
+	local rest      = false;
+	for _, argument in ipairs(args) do
+		local name, value = argument:match("^%-%-([^=]+)=(.*)$");
+		if rest then
+			table.insert(arguments, argument);
+		elseif argument == "--" then
+			rest = true;
+		elseif name then
+			options[name] = value;
+		elseif argument:sub(1, 2) == "--" then
+			options[argument:sub(3)] = true;
+		else
+			table.insert(arguments, argument);
+		end
+	end
+	return options, arguments;
+end
+
+-- Callbacks run after Generate(), in registration order
+function MBuild.OnFinish(callback)
+	table.insert(MBuild.finishCallbacks, callback);
+end
+
+function MBuild:Finish()
+	for _, callback in ipairs(self.finishCallbacks) do
+		callback();
+	end
+end
+
+-- callback(self, arguments) receives the arguments after the command name and returns the exit code
+function MBuild.RegisterCommand(name, callback)
+	MBuild.commands[name] = callback;
+end
+
+function MBuild:Main()
+	local name    = self.arguments[1] or "generate";
+	local command = self.commands[name];
+	if not command then
+		error(string.format("Unknown command '%s'", name));
+	end
+
+	-- Finish also runs when the command fails, the profile of a failed run is the one that matters most
+	local suc, result = pcall(command, self, { unpack(self.arguments, 2) });
+	self:Finish();
+	if not suc then
+		error(result, 0);
+	end
+	return result or 0;
 end
 
 function MBuild:InvokeMainScript(script)
 	local origWorkspaces = self.workspaces;
 	self.workspaces      = {};
 	self.currentScript   = fs.normalize(fs.absolute_script(script, 1));
+	self.ProjectCache.SnapshotGlobals();
 
 	local suc, err = import(self.currentScript);
 	if suc then
@@ -112,8 +262,8 @@ function MBuild:EvaluateConfigs(configMap)
 
 			for k, v in pairs(config.configs) do
 				local conf = MBuild.Configs.configs[k];
-				if conf then
-					config.configs[k] = conf.handler.evaluate(conf, v);
+				if conf and conf.evaluator then
+					config.configs[k] = conf.evaluator(v);
 				end
 			end
 
@@ -212,8 +362,14 @@ function MBuild:ConfigureWorkspace(workspace, previousLayer)
 	workspace.configMap = MBuild.Config.CreateMap(workspace.configurations, workspace.platforms, workspace.configs);
 	self:ConfigureWhens(workspace.configMap, workspace.whens, self.workspaceLayer);
 
+	-- Projects whose inputs didn't change since the last run are restored instead of configured
+	local fingerprint = self.ProjectCache.WorkspaceFingerprint(workspace);
 	for _, project in ipairs(workspace.projects) do
-		self:ConfigureProject(project, self.workspaceLayer);
+		if not self.ProjectCache.Restore(workspace, project, fingerprint) then
+			self.ProjectCache.Record(project, function()
+				self:ConfigureProject(project, self.workspaceLayer);
+			end);
+		end
 	end
 
 	self.currentWorkspace = nil;
@@ -229,19 +385,33 @@ function MBuild:Configure()
 		local origWorkspace = _G.workspace;
 		_G.workspace        = workspace;
 
+		self:EvaluateConfigs(workspace.configMap);
+
 		for _, project in ipairs(workspace.projects) do
 			local origProject = _G.project;
 			_G.project        = project;
-			
-			--for _, files in ipairs(project.files) do
-			--	self:EvaluateConfigs(files.configMap);
-			--end
+
+			if not project.restored then
+				self.ProjectCache.Record(project, function()
+					project.evaluatedLocation = self:TransformString(project.location);
+					self:EvaluateConfigs(project.configMap);
+					for _, files in ipairs(project.files) do
+						self:EvaluateConfigs(files.configMap);
+					end
+				end);
+				self.ProjectCache.Save(workspace, project);
+			end
+
+			for _, files in ipairs(project.files) do
+				files:Expand();
+			end
 
 			_G.project = origProject;
 		end
 
 		_G.workspace = origWorkspace;
 	end
+	self.Files.SaveGlobCache();
 
 	-- Debug
 	for _, workspace in ipairs(self.workspaces) do
@@ -289,4 +459,89 @@ function MBuild:Configure()
 			end
 		end
 	end
-end
\ No newline at end of file
+end
+
+function MBuild:Generate()
+	local toolchains = {};
+	for _, workspace in ipairs(self.workspaces) do
+		for _, project in ipairs(workspace.projects) do
+			for _, arr in pairs(project.configMap) do
+				for _, config in pairs(arr) do
+					local toolchain = self.Toolchains.ForConfig(config);
+					toolchains[toolchain.name] = toolchain;
+				end
+			end
+		end
+	end
+	self.Probe.ProbeToolchains(toolchains);
+
+	local builds = {};
+	for _, workspace in ipairs(self.workspaces) do
+		local buildFiles, contents = self.Ninja.GenerateWorkspace(workspace);
+		for i, buildFile in ipairs(buildFiles) do
+			table.insert(builds, { buildFile = buildFile, outputs = contents[i].outputs, inputs = contents[i].inputs, dyndeps = contents[i].dyndeps });
+		end
+	end
+	self.Clean.Track(builds, self.workspaces);
+end
+
+MBuild.options, MBuild.arguments = MBuild.ParseArguments(_G.arg or {});
+
+-- The main script lives in the working directory, not next to Base.lua
+MBuild.RegisterCommand("generate", function(self)
+	self:InvokeMainScript(fs.absolute("MBuild.lua"));
+	self:Configure();
+	self:Generate();
+	return 0;
+end);
+
+-- The configuration of workspace "mbuild build" and "mbuild test" run, --config and --platform or the first of each
+function MBuild:SelectConfiguration(workspace)
+	local name     = self.options.config or workspace.configurations[1];
+	local platform = self.options.platform or workspace.platforms[1];
+	if not workspace.configMap[name] or not workspace.configMap[name][platform] then
+		error(string.format("Workspace '%s' has no configuration '%s' for platform '%s'", workspace.name, tostring(name), tostring(platform)));
+	end
+	return name, platform;
+end
+
+-- build [targets...] generates the build files and runs ninja on the ones of the selected configuration.
+-- --stats[=output.json] prints a summary of the build and writes it as JSON
+MBuild.RegisterCommand("build", function(self, args)
+	local start = os.monotonic();
+	self:InvokeMainScript(fs.absolute("MBuild.lua"));
+	self:Configure();
+	local configured = os.monotonic();
+	self:Generate();
+	local generated = os.monotonic();
+
+	local jobs   = self.Ninja.Jobs();
+	local stats  = {};
+	local result = 0;
+	for _, workspace in ipairs(self.workspaces) do
+		local buildFile = self.Ninja.BuildFile(workspace, self:SelectConfiguration(workspace));
+		local snapshot  = self.options.stats and self.Stats.Snapshot(buildFile);
+		local executing = os.monotonic();
+		result          = self.Ninja.Run(buildFile, jobs, args);
+		if snapshot then
+			table.insert(stats, self.Stats.Collect(buildFile, snapshot, {
+				configure = configured - start,
+				graph     = generated - configured,
+				execution = os.monotonic() - executing
+			}, jobs));
+		end
+		if result ~= 0 then
+			break;
+		end
+	end
+
+	-- Stats of a failed build still show what ran up to the failure
+	if #stats > 0 then
+		local merged = self.Stats.Merge(stats);
+		self.Stats.Print(merged);
+		if self.options.stats ~= true then
+			self.Stats.Write(merged, fs.normalize(fs.absolute(self.options.stats)));
+		end
+	end
+	return result;
+end);
\ No newline at end of file
@@ -0,0 +1,226 @@
+-- Stale output collection for --gc and "mbuild clean".
+-- Every build file remembers the files it ever produced in .mbuild_outputs next to its .ninja_log: the outputs of its edges
+-- and the files MBuild generates into its build directory, like unity sources. Ninja drops outputs that left the build
+-- file from its log when it recompacts it, so the list is kept by MBuild. --gc removes the remembered files no build file
+-- produces anymore, together with the directories that leaves empty and the configure cache entries of removed projects.
+MBuild.Clean = MBuild.Clean or {
+	stateName = ".mbuild_outputs"
+};
+
+local Clean = MBuild.Clean;
+
+function Clean.StatePath(buildFile)
+	return fs.append(fs.parent_path(buildFile), Clean.stateName);
+end
+
+function Clean.ReadState(buildFile)
+	local files   = {};
+	local content = MBuild.ReadFile(Clean.StatePath(buildFile));
+	for line in (content or ""):gmatch("[^\r\n]+") do
+		table.insert(files, line);
+	end
+	return files;
+end
+
+-- The files a generated build file produces, its outputs and the inputs MBuild wrote into its build directory.
+-- Directories the build file regenerates on, like a RunDir inside the build directory, aren't produced by it
+function Clean.Produced(buildFile, content)
+	local prefix = fs.append(fs.parent_path(buildFile), "");
+	local files  = {};
+	local seen   = {};
+	local function Add(output)
+		if not seen[output] then
+			seen[output] = true;
+			table.insert(files, output);
+		end
+	end
+	for _, output in ipairs(content.outputs) do
+		Add(output);
+	end
+	-- The outputs dyndep files declare exist since the build that wrote them, a missing dyndep file declares none yet
+	for _, dyndep in ipairs(content.dyndeps or {}) do
+		local suc, dyndepGraph = graph.load(dyndep);
+		if suc then
+			for edge = 1, dyndepGraph:edge_count() do
+				for _, node in ipairs(dyndepGraph:outputs(edge)) do
+					Add(dyndepGraph:path(node));
+				end
+			end
+			dyndepGraph:close();
+		end
+	end
+	for _, input in ipairs(content.inputs) do
+		if not seen[input] and input:sub(1, #prefix) == prefix and not fs.is_directory(input) then
+			seen[input] = true;
+			table.insert(files, input);
+		end
+	end
+	return files;
+end
+
+-- Removes the directories below buildDir the removed files left empty, deepest first so parents can go as well
+local function PruneDirectories(files, buildDir)
+	local prefix      = fs.append(buildDir, "");
+	local directories = {};
+	local seen        = {};
+	for _, file in ipairs(files) do
+		local directory = fs.parent_path(file);
+		while not seen[directory] and #directory > #prefix and directory:sub(1, #prefix) == prefix do
+			seen[directory] = true;
+			table.insert(directories, directory);
+			directory = fs.parent_path(directory);
+		end
+	end
+	table.sort(directories, function(a, b) return #a > #b; end);
+	for _, directory in ipairs(directories) do
+		-- Only succeeds for empty directories
+		fs.remove(directory);
+	end
+end
+
+-- Removes the configure cache entries of projects that are gone
+function Clean.PruneProjectCache(workspaces)
+	local keep = {};
+	for _, workspace in ipairs(workspaces) do
+		for _, project in ipairs(workspace.projects) do
+			keep[fs.normalize(MBuild.ProjectCache.EntryPath(workspace, project))] = true;
+		end
+	end
+	local stale = {};
+	for path in fs.directory_iterator(MBuild.ProjectCache.Dir()) do
+		if not keep[fs.normalize(path)] then
+			table.insert(stale, path);
+		end
+	end
+	for _, path in ipairs(stale) do
+		fs.remove(path);
+	end
+	return #stale;
+end
+
+-- Records the files of the generated build files, builds = { { buildFile, outputs, inputs, dyndeps } }.
+-- With --gc the remembered files and the outputs in the ninja logs that no build file produces anymore are removed first,
+-- inputs are never removed, a file that used to be generated may have become a source
+function Clean.Track(builds, workspaces)
+	local collect = MBuild.options.gc;
+	local current = {};
+	local inputs  = {};
+	for _, build in ipairs(builds) do
+		build.files = Clean.Produced(build.buildFile, build);
+		for _, file in ipairs(build.files) do
+			current[file] = true;
+		end
+		if collect then
+			for _, input in ipairs(build.inputs) do
+				inputs[input] = true;
+			end
+		end
+	end
+
+	local stale     = {};
+	local staleSeen = {};
+	for _, build in ipairs(builds) do
+		local known = Clean.ReadState(build.buildFile);
+		if collect then
+			for _, entry in ipairs(MBuild.Stats.ReadLog(MBuild.Stats.LogPath(build.buildFile))) do
+				table.insert(known, entry.output);
+			end
+		end
+
+		local state = {};
+		local seen  = {};
+		for _, list in ipairs({ known, build.files }) do
+			for _, file in ipairs(list) do
+				if not seen[file] then
+					seen[file] = true;
+					if current[file] or not collect then
+						table.insert(state, file);
+					elseif not inputs[file] and not staleSeen[file] then
+						staleSeen[file] = true;
+						table.insert(stale, file);
+					end
+				end
+			end
+		end
+		MBuild.WriteFileIfChanged(Clean.StatePath(build.buildFile), table.concat(state, "\n"));
+	end
+	if not collect then
+		return;
+	end
+
+	local suc, removed = fs.remove_trees(stale, MBuild.Ninja.Jobs());
+	if not suc then
+		printf("Failed to remove stale outputs: %s", removed);
+		removed = 0;
+	end
+	for _, build in ipairs(builds) do
+		PruneDirectories(stale, fs.parent_path(build.buildFile));
+	end
+	printf("Removed %d stale outputs, %d stale configure cache entries", removed, Clean.PruneProjectCache(workspaces));
+end
+
+-- The ObjDir and BinDir trees of the workspaces, --config and --platform limit them to one configuration.
+-- Directories inside another one are left to the outer one, ones containing the working directory are never removed
+function Clean.Trees(workspaces)
+	local directories = {};
+	local seen        = {};
+	local function Add(configs)
+		for _, key in ipairs({ "objDir", "binDir" }) do
+			local directory = configs[key] and fs.append(fs.normalize(fs.absolute(configs[key])), "");
+			if directory and not seen[directory] then
+				seen[directory] = true;
+				table.insert(directories, directory);
+			end
+		end
+	end
+	for _, workspace in ipairs(workspaces) do
+		for name, arr in pairs(workspace.configMap) do
+			for platform, config in pairs(arr) do
+				if (not MBuild.options.config or MBuild.options.config == name) and (not MBuild.options.platform or MBuild.options.platform == platform) then
+					Add(config.configs);
+					for _, project in ipairs(workspace.projects) do
+						Add(project.configMap[name][platform].configs);
+					end
+				end
+			end
+		end
+	end
+
+	local cwd   = fs.append(fs.current_path(), "");
+	local trees = {};
+	table.sort(directories, function(a, b) return #a < #b; end);
+	for _, directory in ipairs(directories) do
+		local nested = false;
+		for _, tree in ipairs(trees) do
+			if directory:sub(1, #tree) == tree then
+				nested = true;
+				break;
+			end
+		end
+		if cwd:sub(1, #directory) == directory then
+			printf("Not removing '%s', it contains the working directory", directory);
+		elseif not nested then
+			table.insert(trees, directory);
+		end
+	end
+	table.sort(trees);
+	return trees;
+end
+
+-- clean removes the ObjDir and BinDir trees of every configuration, or of the one selected with --config and --platform
+MBuild.RegisterCommand("clean", function(self)
+	self:InvokeMainScript(fs.absolute("MBuild.lua"));
+	self:Configure();
+
+	local trees = Clean.Trees(self.workspaces);
+	for _, tree in ipairs(trees) do
+		printf("Removing '%s'", tree);
+	end
+	local suc, removed = fs.remove_trees(trees, self.Ninja.Jobs());
+	if not suc then
+		printf("Failed to clean: %s", removed);
+		return 1;
+	end
+	printf("Removed %d files and directories", removed);
+	return 0;
+end);
\ No newline at end of file
@@ -2,7 +2,7 @@ MBuild.Config = MBuild.Config or {};
 local Config  = MBuild.Config;
 
 function Config:new(name, platform, initialConfigs)
-	config = {
+	local config = {
 		name     = name,
 		platform = platform,
 		arch     = os.arch(), -- Default arch is the current host arch
@@ -16,9 +16,7 @@ function Config:new(name, platform, initialConfigs)
 end
 
 function Config:Apply(configs)
-	for k, v in pairs(configs) do
-		self.configs[k] = v;
-	end
+	MBuild.Merge(self.configs, configs);
 end
 
 function Config.CreateMap(names, platforms, initialConfigs)
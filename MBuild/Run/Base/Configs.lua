@@ -13,7 +13,8 @@ function Handler:new(settings)
 	local handler = {
 		name     = settings.name,
 		callback = settings.callback,
-		evaluate = settings.evaluate
+		evaluate = settings.evaluate,
+		compile  = settings.compile
 	};
 	setmetatable(handler, self);
 	self.__index = self;
@@ -41,6 +42,19 @@ function Configs.TestValid(value, valids)
 	return false;
 end
 
+-- Turns an array of valid values into a set, so checking a value doesn't scan the array
+function Configs.CompileValid(valids)
+	if not valids then
+		return nil;
+	end
+
+	local set = {};
+	for _, v in ipairs(valids) do
+		set[v] = true;
+	end
+	return set;
+end
+
 function Configs.ValidValuesToString(valids)
 	local str = "";
 	for _, v in ipairs(valids) do
@@ -52,7 +66,7 @@ function Configs.ValidValuesToString(valids)
 		if vtype == "table" then
 			str = str .. "table";
 		elseif vtype == "string" then
-			str = str .. string.format("\"%s\"", string.escape(v));
+			str = str .. string.format("%q", v);
 		else
 			str = str .. tostring(v);
 		end
@@ -66,11 +80,24 @@ function Configs.RegisterHandler(settings)
 	Configs.handlers[handler.name] = handler;
 end
 
+-- Handlers with compile(config) return a setter and an evaluator specialized for the registration, a nil evaluator means the value is used as is.
+-- Handlers without it fall back to callback(config, ...) and evaluate(config, value).
 function Configs.RegisterConfig(settings)
-	local config = Config:new(settings);
+	local config    = Config:new(settings);
+	config.validSet = Configs.CompileValid(config.valid);
 
-	Configs.configs[config.key] = config;
-	_G[config.name] = function(...)
-		config.handler.callback(config, ...);
+	local handler = config.handler;
+	if handler.compile then
+		config.setter, config.evaluator = handler.compile(config);
+	else
+		config.setter = function(...)
+			handler.callback(config, ...);
+		end
+		config.evaluator = function(value)
+			return handler.evaluate(config, value);
+		end
 	end
+
+	Configs.configs[config.key] = config;
+	_G[config.name] = config.setter;
 end
\ No newline at end of file
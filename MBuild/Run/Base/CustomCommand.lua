@@ -0,0 +1,121 @@
+MBuild.CustomCommand = MBuild.CustomCommand or {};
+local CustomCommand  = MBuild.CustomCommand;
+
+-- settings = { inputs, outputs, command, description, batch }
+function CustomCommand:new(settings)
+	local customCommand = {
+		inputs      = settings.inputs or {},
+		outputs     = settings.outputs,
+		command     = settings.command,
+		description = settings.description,
+		batch       = settings.batch or 1
+	};
+	setmetatable(customCommand, self);
+	self.__index = self;
+	return customCommand;
+end
+
+-- Outputs referring to ${input} are produced for every input, the others by one invocation over all inputs
+function CustomCommand:IsPerInput()
+	for _, output in ipairs(self.outputs) do
+		if output:find("%${%s*input[^%w_]") then
+			return true;
+		end
+	end
+	return false;
+end
+
+-- Replaces $in and $out with the quoted paths, "$$" is a literal '$'
+function CustomCommand.Expand(command, inputs, outputs)
+	local function Join(paths)
+		local quoted = {};
+		for i, path in ipairs(paths) do
+			quoted[i] = MBuild.ShellQuote(path);
+		end
+		return table.concat(quoted, " ");
+	end
+
+	return (command:gsub("%$(%$?)([%w_]*)", function(escaped, name)
+		if #escaped > 0 then
+			return "$" .. name;
+		elseif name == "in" then
+			return Join(inputs);
+		elseif name == "out" then
+			return Join(outputs);
+		end
+		return "$" .. name;
+	end));
+end
+
+local function LastWriteTime(path)
+	local suc, time = fs.mtime_ns(path);
+	if not suc then
+		return nil;
+	end
+	return time;
+end
+
+-- The later of two times, math.max doesn't take the boxed integers of fs.mtime_ns
+local function Latest(a, b)
+	if not a or (b and a < b) then
+		return b;
+	end
+	return a;
+end
+
+-- Runs the commands of a batch manifest for the inputs whose outputs are missing or older than the input,
+-- the extra inputs or the manifest itself, so a batch only processes what actually changed.
+-- Inputs sharing a command run in one invocation, a command referring to ${input} runs once per input
+function CustomCommand.RunBatch(manifestPath)
+	local manifest = MBuild.Deserialize(manifestPath);
+	if not manifest then
+		printf("Failed to load custom command batch '%s'", manifestPath);
+		return 1;
+	end
+
+	local newest = LastWriteTime(manifestPath);
+	for _, path in ipairs(manifest.implicit) do
+		newest = Latest(newest, LastWriteTime(path));
+	end
+
+	local commands = {};
+	local groups   = {};
+	for _, entry in ipairs(manifest.inputs) do
+		-- A missing input always runs, so the command reports it
+		local input   = LastWriteTime(entry.path);
+		local changed = Latest(newest, input);
+		for _, output in ipairs(entry.outputs) do
+			local time = LastWriteTime(output);
+			if not input or not time or (changed and time < changed) then
+				local group = groups[entry.command];
+				if not group then
+					group                 = { inputs = {}, outputs = {} };
+					groups[entry.command] = group;
+					table.insert(commands, entry.command);
+				end
+				table.insert(group.inputs, entry.path);
+				for _, out in ipairs(entry.outputs) do
+					table.insert(group.outputs, out);
+				end
+				break;
+			end
+		end
+	end
+	for _, command in ipairs(commands) do
+		local group  = groups[command];
+		local result = MBuild.Execute(CustomCommand.Expand(command, group.inputs, group.outputs));
+		if result ~= 0 then
+			return result;
+		end
+	end
+	return 0;
+end
+
+-- custom-batch <manifest>
+MBuild.RegisterCommand("custom-batch", function(self, args)
+	if #args ~= 1 then
+		print("Usage: mbuild custom-batch <manifest>");
+		return 1;
+	end
+	return CustomCommand.RunBatch(args[1]);
+end);
\ No newline at end of file
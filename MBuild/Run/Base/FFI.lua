@@ -0,0 +1,130 @@
+-- Routes the hot fs functions through the C ABI in fs.ffi, LuaJIT can compile FFI calls into traces while every lua_CFunction call aborts them.
+-- The lua_CFunction versions are kept in MBuild.FFI.fallback and still handle error messages and uncommon arguments.
+MBuild.FFI = MBuild.FFI or {
+	enabled  = false,
+	fallback = {}
+};
+
+local FFI = MBuild.FFI;
+
+local hasFFI, ffi = pcall(require, "ffi");
+if not hasFFI or not fs.ffi then
+	return;
+end
+
+ffi.cdef([[
+typedef struct MBuildFSStat {
+	int64_t  lastWriteTime;
+	uint64_t size;
+	int32_t  type;
+} MBuildFSStat;
+]]);
+
+local C = {
+	stat            = ffi.cast("int (*)(const char*, MBuildFSStat*)", fs.ffi.stat),
+	exists          = ffi.cast("int (*)(const char*)", fs.ffi.exists),
+	last_write_time = ffi.cast("int (*)(const char*, int64_t*)", fs.ffi.last_write_time),
+	mtime_ns        = ffi.cast("int (*)(const char*, int64_t*)", fs.ffi.mtime_ns),
+	normalize       = ffi.cast("ptrdiff_t (*)(const char*, char*, size_t)", fs.ffi.normalize),
+	hash            = ffi.cast("uint64_t (*)(const char*, size_t)", fs.ffi.hash),
+	hash_file       = ffi.cast("int (*)(const char*, uint64_t*)", fs.ffi.hash_file)
+};
+
+local typeNames = {
+	[0] = "none",
+	"not_found",
+	"regular",
+	"directory",
+	"symlink",
+	"block",
+	"character",
+	"fifo",
+	"socket",
+	"unknown"
+};
+
+local statBuffer    = ffi.new("MBuildFSStat[1]");
+local int64Buffer   = ffi.new("int64_t[1]");
+local uint64Buffer  = ffi.new("uint64_t[1]");
+local pathBuffer    = ffi.new("char[?]", 4096);
+local pathBufferLen = 4096;
+
+local fallback = FFI.fallback;
+for _, name in ipairs({ "stat", "exists", "last_write_time", "mtime_ns", "normalize", "hash", "hash_file" }) do
+	fallback[name] = fallback[name] or fs[name];
+end
+
+local function HashToString(hash)
+	return bit.tohex(hash, 16);
+end
+
+function fs.stat(path)
+	if type(path) ~= "string" or C.stat(path, statBuffer) ~= 0 then
+		return fallback.stat(path);
+	end
+	local stat = statBuffer[0];
+	return true, {
+		type            = typeNames[stat.type],
+		size            = tonumber(stat.size),
+		last_write_time = tonumber(stat.lastWriteTime)
+	};
+end
+
+function fs.exists(path)
+	if type(path) ~= "string" then
+		return fallback.exists(path);
+	end
+	local res = C.exists(path);
+	if res < 0 then
+		return fallback.exists(path);
+	end
+	return res == 1;
+end
+
+function fs.last_write_time(path, newTime)
+	if newTime ~= nil or type(path) ~= "string" or C.last_write_time(path, int64Buffer) ~= 0 then
+		return fallback.last_write_time(path, newTime);
+	end
+	return true, tonumber(int64Buffer[0]);
+end
+
+-- The time stays a boxed int64_t, a Lua number can't hold nanoseconds since the epoch exactly.
+-- Boxed integers compare with == and <, and MBuild.Serialize writes them as LL literals
+function fs.mtime_ns(path)
+	if type(path) ~= "string" or C.mtime_ns(path, int64Buffer) ~= 0 then
+		return fallback.mtime_ns(path);
+	end
+	return true, int64Buffer[0];
+end
+
+function fs.normalize(path)
+	if type(path) ~= "string" then
+		return fallback.normalize(path);
+	end
+	local len = tonumber(C.normalize(path, pathBuffer, pathBufferLen));
+	if len >= pathBufferLen then
+		pathBufferLen = len + 1;
+		pathBuffer    = ffi.new("char[?]", pathBufferLen);
+		len           = tonumber(C.normalize(path, pathBuffer, pathBufferLen));
+	end
+	if len < 0 then
+		return fallback.normalize(path);
+	end
+	return ffi.string(pathBuffer, len);
+end
+
+function fs.hash(data)
+	if type(data) ~= "string" then
+		return fallback.hash(data);
+	end
+	return HashToString(C.hash(data, #data));
+end
+
+function fs.hash_file(path)
+	if type(path) ~= "string" or C.hash_file(path, uint64Buffer) ~= 0 then
+		return fallback.hash_file(path);
+	end
+	return true, HashToString(uint64Buffer[0]);
+end
+
+FFI.enabled = true;
\ No newline at end of file
@@ -1,4 +1,6 @@
-MBuild.Files = MBuild.Files or {};
+MBuild.Files = MBuild.Files or {
+	globCache = nil -- Loaded by the first glob
+};
 local Files  = MBuild.Files;
 
 function Files:new(inclusions, exclusions, callback)
@@ -8,10 +10,215 @@ function Files:new(inclusions, exclusions, callback)
 		callback   = callback,
 		whens      = {},
 
+		customCommands = {},
+
 		configs   = {},
 		configMap = {}
 	};
 	setmetatable(files, self);
 	self.__index = self;
 	return files;
+end
+
+local function GlobToPattern(glob)
+	local pattern = glob:gsub("[%^%$%(%)%%%.%[%]%+%-]", "%%%0");
+	pattern       = pattern:gsub("%*%*/?", "\1"):gsub("%*", "[^/]*"):gsub("%?", "[^/]"):gsub("\1", ".*");
+	return "^" .. pattern .. "$";
+end
+
+local function NormalizeSlashes(path)
+	return (path:gsub("\\", "/"));
+end
+
+function Files.GlobCachePath()
+	return fs.append(MBuild.CacheDir(), "Glob.cache");
+end
+
+-- The cache is a list of directories, each a "<time>\t<id>\t<path>" line followed by "f\t<name>" and "d\t<name>" lines
+-- for its files and subdirectories. Plain lines instead of Serialize() keep huge trees within the constant limits of loadfile()
+function Files.LoadGlobCache()
+	if Files.globCache then
+		return Files.globCache;
+	end
+
+	local cache = { entries = {}, visited = {} };
+	Files.globCache = cache;
+
+	local suc, buffer = fs.read(Files.GlobCachePath());
+	if not suc then
+		return cache;
+	end
+	-- Caches from another version are dropped without copying them out of the mapping
+	if buffer:sub(1, 17) ~= "MBuildGlobCache 1" then
+		buffer:close();
+		return cache;
+	end
+	local content = buffer:string();
+	buffer:close();
+
+	local entry = { files = {}, dirs = {} };
+	for kind, name in content:gmatch("([^\t\n]+)\t([^\n]*)\n") do
+		if kind == "f" then
+			table.insert(entry.files, name);
+		elseif kind == "d" then
+			table.insert(entry.dirs, name);
+		else
+			local id, path = name:match("^([^\t]+)\t(.*)$");
+			entry = { time = tonumber(kind), id = tonumber(id), files = {}, dirs = {} };
+			cache.entries[path] = entry;
+		end
+	end
+	cache.content = content;
+	return cache;
+end
+
+-- Only writes the directories globbed this run, so removed directories drop out of the cache
+function Files.SaveGlobCache()
+	local cache = Files.globCache;
+	if not cache then
+		return;
+	end
+
+	local dirs = {};
+	for dir, entry in pairs(cache.visited) do
+		if not entry.racy then
+			table.insert(dirs, dir);
+		end
+	end
+	table.sort(dirs);
+
+	local lines = { "MBuildGlobCache 1" };
+	for _, dir in ipairs(dirs) do
+		local entry = cache.visited[dir];
+		table.insert(lines, string.format("%.0f\t%.0f\t%s", entry.time, entry.id, dir));
+		for _, name in ipairs(entry.files) do
+			table.insert(lines, "f\t" .. name);
+		end
+		for _, name in ipairs(entry.dirs) do
+			table.insert(lines, "d\t" .. name);
+		end
+	end
+	local content = table.concat(lines, "\n") .. "\n";
+	if content ~= cache.content then
+		MBuild.WriteFileIfChanged(Files.GlobCachePath(), content);
+		cache.content = content;
+	end
+end
+
+-- Returns the files and subdirectories of dir, only listing it again when its stamp changed since the cached listing.
+-- Adding, removing or renaming an entry updates the stamp of its directory, so an unchanged stamp costs one stat.
+function Files.ListDirectory(dir)
+	local cache = Files.LoadGlobCache();
+	local entry = cache.visited[dir];
+	if entry then
+		return entry;
+	end
+
+	local suc, time, id = fs.directory_stamp(dir);
+	if not suc then
+		return nil;
+	end
+	entry = cache.entries[dir];
+	if not entry or entry.time ~= time or entry.id ~= id then
+		local files, dirs;
+		suc, time, id, files, dirs = fs.scan_directory(dir);
+		if not suc then
+			return nil;
+		end
+		table.sort(files);
+		table.sort(dirs);
+		entry = { time = time, id = id, files = files, dirs = dirs };
+
+		-- Entries created within the timestamp granularity after listing wouldn't change the stamp, so recent directories are listed again next run
+		entry.racy = time >= (os.time() - 2) * 1000000;
+		for _, name in ipairs(files) do
+			entry.racy = entry.racy or name:find("\n") ~= nil;
+		end
+		for _, name in ipairs(dirs) do
+			entry.racy = entry.racy or name:find("\n") ~= nil;
+		end
+	end
+	cache.visited[dir] = entry;
+	return entry;
+end
+
+-- Appends the files of dir, and of its subdirectories when recursive, dir has to end with a '/'
+local function CollectFiles(dir, recursive, matches)
+	local entry = Files.ListDirectory(dir);
+	if not entry then
+		return;
+	end
+	for _, name in ipairs(entry.files) do
+		table.insert(matches, dir .. name);
+	end
+	if recursive then
+		for _, name in ipairs(entry.dirs) do
+			CollectFiles(dir .. name .. "/", true, matches);
+		end
+	end
+end
+
+function Files.Glob(glob)
+	glob = NormalizeSlashes(fs.normalize(fs.absolute(MBuild:TransformString(glob))));
+
+	local wildcard = glob:find("[%*%?]");
+	if not wildcard then
+		if fs.is_regular_file(glob) then
+			return { glob };
+		end
+		return {};
+	end
+
+	local base    = glob:sub(1, wildcard - 1):match("^(.*/)") or "./";
+	local pattern = GlobToPattern(glob);
+
+	-- Subdirectories only have to be listed when a wildcard spans directories
+	local files = {};
+	CollectFiles(base, glob:find("/", wildcard, true) ~= nil or glob:find("**", wildcard, true) ~= nil, files);
+
+	local matches = {};
+	for _, path in ipairs(files) do
+		if path:find(pattern) then
+			table.insert(matches, path);
+		end
+	end
+	table.sort(matches);
+	return matches;
+end
+
+function Files:IsExcluded(path)
+	for _, exclusion in ipairs(self.exclusionPatterns) do
+		if exclusion.filenameOnly then
+			if path:match("[^/]*$"):find(exclusion.pattern) then
+				return true;
+			end
+		elseif path:find(exclusion.pattern) then
+			return true;
+		end
+	end
+	return false;
+end
+
+function Files:Expand()
+	self.exclusionPatterns = {};
+	for _, exclusion in ipairs(self.exclusions) do
+		exclusion = NormalizeSlashes(MBuild:TransformString(exclusion));
+		if exclusion:find("/") then
+			table.insert(self.exclusionPatterns, { pattern = GlobToPattern(NormalizeSlashes(fs.normalize(fs.absolute(exclusion)))) });
+		else
+			table.insert(self.exclusionPatterns, { pattern = GlobToPattern(exclusion), filenameOnly = true });
+		end
+	end
+
+	self.paths = {};
+	local seen = {};
+	for _, inclusion in ipairs(self.inclusions) do
+		for _, path in ipairs(Files.Glob(inclusion)) do
+			if not seen[path] and not self:IsExcluded(path) then
+				seen[path] = true;
+				table.insert(self.paths, path);
+			end
+		end
+	end
+	return self.paths;
 end
\ No newline at end of file
@@ -5,6 +5,9 @@ end
 function import(filename)
 	local path              = fs.normalize(fs.absolute_script(filename, 1));
 	_G._MBuildImports       = _G._MBuildImports or {};
+	if MBuild and MBuild.ProjectCache then
+		MBuild.ProjectCache.OnScript(path);
+	end
 	if _G._MBuildImports[path] then
 		return unpack(_G._MBuildImports[path]);
 	end
@@ -27,17 +30,35 @@ end
 
 function include(filename)
 	local path = fs.normalize(fs.absolute_script(filename, 1));
+	if MBuild and MBuild.ProjectCache then
+		MBuild.ProjectCache.OnScript(path);
+	end
 	return dofile(path);
 end
 
 local files = {
 	"Base.lua",
+	"JSON.lua",
+	"FFI.lua",
+	"Profile.lua",
+	"JITReport.lua",
 	"Workspace.lua",
 	"Project.lua",
 	"Files.lua",
+	"CustomCommand.lua",
 	"When.lua",
 	"Config.lua",
 	"Configs.lua",
+	"ProjectCache.lua",
+	"Toolchain.lua",
+	"Probe.lua",
+	"Unity.lua",
+	"Ninja.lua",
+	"Modules.lua",
+	"Package.lua",
+	"Stats.lua",
+	"Test.lua",
+	"Clean.lua",
 
 	"API.lua"
 };
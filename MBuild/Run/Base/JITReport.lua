@@ -0,0 +1,230 @@
+-- Records trace events while the scripts run, enabled with --jit-report[=output].
+-- Every trace is attributed to the location it started at, so loops that keep aborting or got blacklisted show up with their abort reasons.
+MBuild.JITReport = MBuild.JITReport or {
+	locations = {},
+	traces    = {},
+	flushes   = 0,
+	prefix    = "",
+	running   = false
+};
+
+local JITReport = MBuild.JITReport;
+
+local hasUtil, jutil  = pcall(require, "jit.util");
+local hasVMDef, vmdef = pcall(require, "jit.vmdef");
+
+-- Interpreter only variants the loop and function headers get patched into when blacklisted
+local blacklistedOps = {
+	IFORL  = true,
+	IITERL = true,
+	IITERN = true,
+	ILOOP  = true,
+	IFUNCF = true,
+	IFUNCV = true
+};
+
+-- Scripts are loaded through their absolute path, strip the working directory so locations stay readable
+local function ShortenSource(source, line)
+	local prefix = JITReport.prefix;
+	source       = source:gsub("^@", "");
+	if #prefix > 0 and source:sub(1, #prefix) == prefix then
+		source = source:sub(#prefix + 1);
+	end
+	return string.format("%s:%d", source, line);
+end
+
+local function FunctionName(func)
+	local info = jutil.funcinfo(func);
+	if info.source then
+		return ShortenSource(info.source, info.linedefined);
+	elseif info.ffid then
+		if hasVMDef then
+			return vmdef.ffnames[info.ffid];
+		end
+		return "builtin#" .. tostring(info.ffid);
+	elseif info.addr then
+		return string.format("C:%x", info.addr);
+	end
+	return "?";
+end
+
+local function Location(func, pc)
+	local info = jutil.funcinfo(func, pc);
+	if info.source then
+		return ShortenSource(info.source, info.currentline);
+	end
+	return FunctionName(func);
+end
+
+local function AbortReason(err, info)
+	if type(err) ~= "number" then
+		return tostring(err);
+	end
+	if type(info) == "function" then
+		info = FunctionName(info);
+	end
+	if hasVMDef and vmdef.traceerr[err] then
+		return string.format(vmdef.traceerr[err], info);
+	end
+	return string.format("error %d (%s)", err, tostring(info));
+end
+
+-- Without jit.vmdef the opcode numbers can't be mapped to names, so blacklisting can't be detected
+local function IsBlacklisted(func, pc)
+	if not hasVMDef then
+		return false;
+	end
+	local ins = jutil.funcbc(func, pc);
+	if not ins then
+		return false;
+	end
+	local op = bit.band(ins, 0xff);
+	return blacklistedOps[vmdef.bcnames:sub(op * 6 + 1, op * 6 + 6):match("%S+")] == true;
+end
+
+local function GetLocation(func, pc)
+	local key      = Location(func, pc);
+	local location = JITReport.locations[key];
+	if not location then
+		location = {
+			key     = key,
+			func    = func,
+			pc      = pc,
+			starts  = 0,
+			stops   = 0,
+			aborts  = 0,
+			reasons = {}
+		};
+		JITReport.locations[key] = location;
+	end
+	return location;
+end
+
+local function OnTrace(what, tr, func, pc, otr, oex)
+	if what == "start" then
+		local location       = GetLocation(func, pc);
+		location.starts      = location.starts + 1;
+		JITReport.traces[tr] = location;
+	elseif what == "stop" then
+		local location = JITReport.traces[tr];
+		if location then
+			location.stops       = location.stops + 1;
+			JITReport.traces[tr] = nil;
+		end
+	elseif what == "abort" then
+		local location = JITReport.traces[tr];
+		if location then
+			local reason             = string.format("%s at %s", AbortReason(otr, oex), Location(func, pc));
+			location.aborts          = location.aborts + 1;
+			location.reasons[reason] = (location.reasons[reason] or 0) + 1;
+			JITReport.traces[tr]     = nil;
+		end
+	elseif what == "flush" then
+		JITReport.flushes = JITReport.flushes + 1;
+		JITReport.traces  = {};
+	end
+end
+
+function JITReport.Start(output)
+	if not hasUtil or not jit or not jit.attach then
+		print("--jit-report requires LuaJIT with jit.util, the report is disabled");
+		return false;
+	end
+
+	JITReport.output    = output;
+	JITReport.locations = {};
+	JITReport.traces    = {};
+	JITReport.flushes   = 0;
+	JITReport.prefix    = fs.normalize(fs.current_path() .. "/");
+	JITReport.running   = true;
+	jit.attach(OnTrace, "trace");
+	return true;
+end
+
+function JITReport.Report()
+	local locations = {};
+	for _, location in pairs(JITReport.locations) do
+		location.blacklisted = IsBlacklisted(location.func, location.pc);
+		table.insert(locations, location);
+	end
+	table.sort(locations, function(a, b)
+		if a.aborts ~= b.aborts then
+			return a.aborts > b.aborts;
+		end
+		return a.key < b.key;
+	end);
+
+	local starts, stops, aborts, blacklisted = 0, 0, 0, 0;
+	local lines = {};
+	for _, location in ipairs(locations) do
+		starts = starts + location.starts;
+		stops  = stops + location.stops;
+		aborts = aborts + location.aborts;
+
+		local status;
+		if location.blacklisted then
+			status      = "blacklisted";
+			blacklisted = blacklisted + 1;
+		elseif location.stops == 0 then
+			status = "not compiled";
+		else
+			status = "compiled";
+		end
+		table.insert(lines, string.format("%s: %d starts, %d traces, %d aborts, %s", location.key, location.starts, location.stops, location.aborts, status));
+
+		local reasons = {};
+		for reason, count in pairs(location.reasons) do
+			table.insert(reasons, { reason = reason, count = count });
+		end
+		table.sort(reasons, function(a, b)
+			if a.count ~= b.count then
+				return a.count > b.count;
+			end
+			return a.reason < b.reason;
+		end);
+		for _, reason in ipairs(reasons) do
+			table.insert(lines, string.format("  %4d x %s", reason.count, reason.reason));
+		end
+	end
+	if not hasVMDef then
+		table.insert(lines, 1, "jit.vmdef is not in package.path, abort reasons are LuaJIT error numbers and blacklisting is not detected");
+	end
+	table.insert(lines, 1, string.format("JIT report: %d trace starts, %d traces, %d aborts, %d blacklisted locations, %d flushes", starts, stops, aborts, blacklisted, JITReport.flushes));
+	return table.concat(lines, "\n") .. "\n";
+end
+
+function JITReport.Stop()
+	if not JITReport.running then
+		return nil;
+	end
+	jit.attach(OnTrace);
+	JITReport.running = false;
+
+	local report = JITReport.Report();
+	if JITReport.output then
+		fs.create_directories(fs.parent_path(JITReport.output));
+		local file = io.open(JITReport.output, "wb");
+		if not file then
+			print(string.format("Failed to write JIT report '%s'", JITReport.output));
+			return nil;
+		end
+		file:write(report);
+		file:close();
+		printf("JIT report written to '%s'", JITReport.output);
+	else
+		io.write(report);
+	end
+	return report;
+end
+
+local output = MBuild.options["jit-report"];
+if output and not JITReport.running then
+	if output ~= true then
+		output = fs.normalize(fs.absolute(output));
+	else
+		output = nil;
+	end
+	if JITReport.Start(output) then
+		MBuild.OnFinish(JITReport.Stop);
+	end
+end
\ No newline at end of file
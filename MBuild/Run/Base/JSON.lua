@@ -0,0 +1,258 @@
+MBuild.JSON = MBuild.JSON or {
+	-- Decoded JSON null, so keys with a null value still show up in pairs()
+	null = setmetatable({}, { __tostring = function() return "null"; end })
+};
+
+local JSON = MBuild.JSON;
+
+local escapes = {
+	["\""] = "\"",
+	["\\"] = "\\",
+	["/"]  = "/",
+	b      = "\b",
+	f      = "\f",
+	n      = "\n",
+	r      = "\r",
+	t      = "\t"
+};
+
+local function CodepointToUTF8(code)
+	if code < 0x80 then
+		return string.char(code);
+	elseif code < 0x800 then
+		return string.char(0xC0 + bit.rshift(code, 6), 0x80 + bit.band(code, 0x3F));
+	elseif code < 0x10000 then
+		return string.char(0xE0 + bit.rshift(code, 12), 0x80 + bit.band(bit.rshift(code, 6), 0x3F), 0x80 + bit.band(code, 0x3F));
+	end
+	return string.char(0xF0 + bit.rshift(code, 18), 0x80 + bit.band(bit.rshift(code, 12), 0x3F), 0x80 + bit.band(bit.rshift(code, 6), 0x3F), 0x80 + bit.band(code, 0x3F));
+end
+
+local DecodeValue;
+
+local function SkipWhitespace(str, pos)
+	return str:find("[^ \t\r\n]", pos) or #str + 1;
+end
+
+local function DecodeError(str, pos, message)
+	local line = 1;
+	for _ in str:sub(1, pos - 1):gmatch("\n") do
+		line = line + 1;
+	end
+	error(string.format("JSON: %s at line %d", message, line), 0);
+end
+
+local function DecodeString(str, pos)
+	local parts = {};
+	local i     = pos + 1;
+	while true do
+		local j = str:find("[\"\\]", i);
+		if not j then
+			DecodeError(str, pos, "unterminated string");
+		end
+		table.insert(parts, str:sub(i, j - 1));
+		if str:sub(j, j) == "\"" then
+			return table.concat(parts), j + 1;
+		end
+
+		local c = str:sub(j + 1, j + 1);
+		if c == "u" then
+			local code = tonumber(str:sub(j + 2, j + 5), 16);
+			if not code then
+				DecodeError(str, j, "invalid unicode escape");
+			end
+			i = j + 6;
+			-- Surrogate pairs encode codepoints above the basic multilingual plane
+			if code >= 0xD800 and code < 0xDC00 and str:sub(i, i + 1) == "\\u" then
+				local low = tonumber(str:sub(i + 2, i + 5), 16);
+				if low and low >= 0xDC00 and low < 0xE000 then
+					code = 0x10000 + (code - 0xD800) * 0x400 + (low - 0xDC00);
+					i    = i + 6;
+				end
+			end
+			table.insert(parts, CodepointToUTF8(code));
+		elseif escapes[c] then
+			table.insert(parts, escapes[c]);
+			i = j + 2;
+		else
+			DecodeError(str, j, "invalid escape '\\" .. c .. "'");
+		end
+	end
+end
+
+local function DecodeArray(str, pos)
+	local array = {};
+	pos         = SkipWhitespace(str, pos + 1);
+	if str:sub(pos, pos) == "]" then
+		return array, pos + 1;
+	end
+	while true do
+		local value;
+		value, pos = DecodeValue(str, pos);
+		table.insert(array, value);
+		pos     = SkipWhitespace(str, pos);
+		local c = str:sub(pos, pos);
+		if c == "]" then
+			return array, pos + 1;
+		elseif c ~= "," then
+			DecodeError(str, pos, "expected ',' or ']'");
+		end
+		pos = SkipWhitespace(str, pos + 1);
+	end
+end
+
+local function DecodeObject(str, pos)
+	local object = {};
+	pos          = SkipWhitespace(str, pos + 1);
+	if str:sub(pos, pos) == "}" then
+		return object, pos + 1;
+	end
+	while true do
+		if str:sub(pos, pos) ~= "\"" then
+			DecodeError(str, pos, "expected string key");
+		end
+		local key;
+		key, pos = DecodeString(str, pos);
+		pos      = SkipWhitespace(str, pos);
+		if str:sub(pos, pos) ~= ":" then
+			DecodeError(str, pos, "expected ':'");
+		end
+		object[key], pos = DecodeValue(str, SkipWhitespace(str, pos + 1));
+		pos     = SkipWhitespace(str, pos);
+		local c = str:sub(pos, pos);
+		if c == "}" then
+			return object, pos + 1;
+		elseif c ~= "," then
+			DecodeError(str, pos, "expected ',' or '}'");
+		end
+		pos = SkipWhitespace(str, pos + 1);
+	end
+end
+
+DecodeValue = function(str, pos)
+	local c = str:sub(pos, pos);
+	if c == "{" then
+		return DecodeObject(str, pos);
+	elseif c == "[" then
+		return DecodeArray(str, pos);
+	elseif c == "\"" then
+		return DecodeString(str, pos);
+	elseif str:sub(pos, pos + 3) == "true" then
+		return true, pos + 4;
+	elseif str:sub(pos, pos + 4) == "false" then
+		return false, pos + 5;
+	elseif str:sub(pos, pos + 3) == "null" then
+		return JSON.null, pos + 4;
+	end
+
+	local number = str:match("^-?%d+%.?%d*[eE]?[-+]?%d*", pos);
+	if number and #number > 0 and tonumber(number) then
+		return tonumber(number), pos + #number;
+	end
+	DecodeError(str, pos, "unexpected '" .. c .. "'");
+end
+
+-- Returns the decoded value, or false and a message when str isn't valid JSON
+function JSON.Decode(str)
+	local suc, value, pos = pcall(DecodeValue, str, SkipWhitespace(str, 1));
+	if not suc then
+		return false, value;
+	end
+	if SkipWhitespace(str, pos) <= #str then
+		return false, "JSON: trailing characters after the value";
+	end
+	return value;
+end
+
+local encodeEscapes = {
+	["\""] = "\\\"",
+	["\\"] = "\\\\",
+	["\b"] = "\\b",
+	["\f"] = "\\f",
+	["\n"] = "\\n",
+	["\r"] = "\\r",
+	["\t"] = "\\t"
+};
+
+local function EncodeString(str)
+	return "\"" .. str:gsub("[%c\"\\]", function(c)
+		return encodeEscapes[c] or string.format("\\u%04x", c:byte());
+	end) .. "\"";
+end
+
+-- Tables with only the keys 1..n are arrays, empty tables encode as arrays as well
+local function IsArray(tbl)
+	local count = 0;
+	for _ in pairs(tbl) do
+		count = count + 1;
+	end
+	return count == #tbl;
+end
+
+local function EncodeValue(value, indent, current, parts)
+	local vtype = type(value);
+	if value == nil or value == JSON.null then
+		table.insert(parts, "null");
+	elseif vtype == "boolean" then
+		table.insert(parts, tostring(value));
+	elseif vtype == "number" then
+		if value ~= value or value == math.huge or value == -math.huge then
+			table.insert(parts, "null");
+		elseif value == math.floor(value) and math.abs(value) < 2 ^ 53 then
+			table.insert(parts, string.format("%d", value));
+		else
+			table.insert(parts, string.format("%.14g", value));
+		end
+	elseif vtype == "string" then
+		table.insert(parts, EncodeString(value));
+	elseif vtype == "table" then
+		local inner     = indent and (current .. indent) or "";
+		local separator = indent and (",\n" .. inner) or ",";
+		local open      = indent and ("\n" .. inner) or "";
+		local close     = indent and ("\n" .. current) or "";
+		if IsArray(value) then
+			if #value == 0 then
+				table.insert(parts, "[]");
+				return;
+			end
+			table.insert(parts, "[" .. open);
+			for i, v in ipairs(value) do
+				if i > 1 then
+					table.insert(parts, separator);
+				end
+				EncodeValue(v, indent, inner, parts);
+			end
+			table.insert(parts, close .. "]");
+		else
+			-- Sorted keys, so equal values always encode to the same text
+			local keys = {};
+			for k, _ in pairs(value) do
+				if type(k) ~= "string" then
+					error(string.format("JSON: object keys have to be strings, got '%s'", type(k)), 0);
+				end
+				table.insert(keys, k);
+			end
+			table.sort(keys);
+			table.insert(parts, "{" .. open);
+			for i, k in ipairs(keys) do
+				if i > 1 then
+					table.insert(parts, separator);
+				end
+				table.insert(parts, EncodeString(k) .. (indent and ": " or ":"));
+				EncodeValue(value[k], indent, inner, parts);
+			end
+			table.insert(parts, close .. "}");
+		end
+	else
+		error(string.format("JSON: can't encode '%s'", vtype), 0);
+	end
+end
+
+-- Returns the JSON text of value, indented with indent when given, or false and a message
+function JSON.Encode(value, indent)
+	local parts    = {};
+	local suc, err = pcall(EncodeValue, value, indent, "", parts);
+	if not suc then
+		return false, err;
+	end
+	return table.concat(parts);
+end
\ No newline at end of file
@@ -0,0 +1,213 @@
+-- C++20 module support, the build files run these through "mbuild scan-deps" and "mbuild collate-modules".
+-- Every C++ source of a project with Modules(true) is scanned for P1689 dependency info, the collate step then turns
+-- the scan results into a ninja dyndep file ordering each import after the unit providing it.
+MBuild.Modules = MBuild.Modules or {};
+
+local Modules = MBuild.Modules;
+
+function Modules.CacheDir()
+	return fs.append(MBuild.CacheDir(), "Scan");
+end
+
+function Modules.BMIPath(bmiDir, toolchain, name)
+	-- Partitions are named "module:partition", ':' isn't valid in Windows filenames
+	return fs.append(bmiDir, name:gsub(":", "-") .. toolchain.modules.bmiExt);
+end
+
+-- Returns the prerequisites of a make style depfile
+function Modules.ParseDepfile(content)
+	content     = content:gsub("\\\r?\n", " ");
+	local colon = content:find(":[ \t\r\n]");
+	if not colon then
+		return {};
+	end
+
+	local paths = {};
+	for path in content:sub(colon + 1):gsub("\\ ", "\0"):gmatch("%S+") do
+		table.insert(paths, (path:gsub("%z", " "):gsub("%$%$", "$")));
+	end
+	return paths;
+end
+
+-- Scan results only depend on the content of the source and everything it included, so an entry is keyed by the
+-- command and the source hash and stays valid as long as all of its recorded dependencies hash the same
+local function LoadScanEntry(path)
+	local entry = MBuild.Deserialize(path);
+	if not entry or type(entry.deps) ~= "table" then
+		return nil;
+	end
+	for dep, hash in pairs(entry.deps) do
+		local suc, current = fs.hash_file(dep);
+		if not suc or current ~= hash then
+			return nil;
+		end
+	end
+	return entry;
+end
+
+-- Runs command, which writes the P1689 output to out.tmp and a depfile to out.d, unless the cache already has the result
+function Modules.Scan(out, source, command)
+	local depfile = out .. ".d";
+	local suc, sourceHash = fs.hash_file(source);
+	if not suc then
+		printf("Failed to hash '%s': %s", source, tostring(sourceHash));
+		return 1;
+	end
+
+	local entryPath = fs.append(Modules.CacheDir(), fs.hash(command .. "\0" .. sourceHash) .. ".lua");
+	local entry     = LoadScanEntry(entryPath);
+	if not entry then
+		-- GCC writes the preprocessed source next to the scan output, only the scan results are kept
+		local result = MBuild.Execute(command);
+		os.remove(out .. ".i");
+		if result ~= 0 then
+			return result;
+		end
+
+		entry = {
+			ddi     = MBuild.ReadFile(out .. ".tmp"),
+			depfile = MBuild.ReadFile(depfile) or "",
+			deps    = {}
+		};
+		os.remove(out .. ".tmp");
+		if not entry.ddi then
+			printf("Scanning '%s' didn't produce '%s'", source, out);
+			return 1;
+		end
+
+		for _, dep in ipairs(Modules.ParseDepfile(entry.depfile)) do
+			local hashed, hash = fs.hash_file(dep);
+			if hashed then
+				entry.deps[fs.normalize(fs.absolute(dep))] = hash;
+			end
+		end
+		MBuild.WriteFileIfChanged(entryPath, MBuild.Serialize(entry));
+	end
+
+	-- The depfile is consumed by ninja on every run, the scan output is only touched when it changed so collation can be skipped
+	MBuild.WriteFileIfChanged(depfile, entry.depfile);
+	MBuild.WriteFileIfChanged(out, entry.ddi);
+	return 0;
+end
+
+-- Returns the rules of a P1689 file, which describe the modules each object provides and requires
+function Modules.ReadScan(path)
+	local content = MBuild.ReadFile(path);
+	if not content then
+		error(string.format("Failed to read scan results '%s'", path));
+	end
+	local data, err = MBuild.JSON.Decode(content);
+	if not data then
+		error(string.format("Failed to parse scan results '%s': %s", path, err));
+	end
+	if type(data.rules) ~= "table" then
+		error(string.format("Scan results '%s' don't contain any rules", path));
+	end
+	return data.rules;
+end
+
+local function CollectRequires(name, providers, closure)
+	local provider = providers[name];
+	if closure[name] or not provider then
+		return;
+	end
+	closure[name] = provider.bmi;
+	for _, require in ipairs(provider.rule.requires or {}) do
+		CollectRequires(require["logical-name"], providers, closure);
+	end
+end
+
+-- Writes the dyndep file output and a modmap next to every scanned object, holding the flags that map its modules to BMIs
+function Modules.Collate(toolchain, output, bmiDir, scans)
+	local providers = {};
+	local objects   = {};
+	for _, scan in ipairs(scans) do
+		for _, rule in ipairs(Modules.ReadScan(scan)) do
+			local object = rule["primary-output"];
+			for _, provide in ipairs(rule.provides or {}) do
+				local name = provide["logical-name"];
+				if providers[name] then
+					error(string.format("Module '%s' is provided by both '%s' and '%s'", name, providers[name].object, object));
+				end
+				providers[name] = { object = object, rule = rule, bmi = Modules.BMIPath(bmiDir, toolchain, name) };
+			end
+			table.insert(objects, { object = object, rule = rule });
+		end
+	end
+
+	-- Compilers write the BMIs without creating their directory
+	fs.create_directories(bmiDir);
+
+	local writer = MBuild.Ninja.Writer:new();
+	writer:Variable("ninja_dyndep_version", "1");
+	for _, entry in ipairs(objects) do
+		local rule     = entry.rule;
+		local provided = {};
+		local required = {};
+		local lines    = {};
+		for _, provide in ipairs(rule.provides or {}) do
+			local name = provide["logical-name"];
+			table.insert(provided, providers[name].bmi);
+			table.insert(lines, toolchain.modules.provide(name, providers[name].bmi, provide["is-interface"] ~= false));
+		end
+
+		local closure = {};
+		for _, require in ipairs(rule.requires or {}) do
+			local name = require["logical-name"];
+			if not providers[name] then
+				error(string.format("'%s' imports module '%s', which no scanned source provides", entry.object, name));
+			end
+			if providers[name].object ~= entry.object then
+				table.insert(required, providers[name].bmi);
+			end
+			CollectRequires(name, providers, closure);
+		end
+		local names = {};
+		for name, _ in pairs(closure) do
+			table.insert(names, name);
+		end
+		table.sort(names);
+		for _, name in ipairs(names) do
+			if providers[name].object ~= entry.object then
+				table.insert(lines, toolchain.modules.reference(name, closure[name]));
+			end
+		end
+
+		MBuild.WriteFileIfChanged(entry.object .. ".modmap", table.concat(lines, "\n") .. "\n");
+		writer:Build({
+			outputs         = { entry.object },
+			implicitOutputs = provided,
+			rule            = "dyndep",
+			implicit        = required
+		});
+	end
+	MBuild.WriteFileIfChanged(output, writer:ToString());
+	return 0;
+end
+
+-- scan-deps <out> <source> <command...>
+MBuild.RegisterCommand("scan-deps", function(self, args)
+	if #args < 3 then
+		print("Usage: mbuild scan-deps <out> <source> -- <command...>");
+		return 1;
+	end
+	local command = {};
+	for i = 3, #args do
+		table.insert(command, MBuild.ShellQuote(args[i]));
+	end
+	return Modules.Scan(args[1], args[2], table.concat(command, " "));
+end);
+
+-- collate-modules <toolchain> <out> <bmi dir> <scan results...>
+MBuild.RegisterCommand("collate-modules", function(self, args)
+	if #args < 3 then
+		print("Usage: mbuild collate-modules <toolchain> <out> <bmi dir> <scan results...>");
+		return 1;
+	end
+	local toolchain = MBuild.Toolchains.Get(args[1]);
+	if not toolchain.modules then
+		printf("'%s' doesn't support C++20 modules", toolchain.name);
+		return 1;
+	end
+	return Modules.Collate(toolchain, args[2], args[3], { unpack(args, 4) });
+end);
\ No newline at end of file
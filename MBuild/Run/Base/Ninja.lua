@@ -0,0 +1,769 @@
+MBuild.Ninja = MBuild.Ninja or {
+	-- Links are mostly bound by memory and disk, so only a quarter of the cores link at once
+	linkPoolDepth = math.max(2, math.floor(os.cpu().cores / 4))
+};
+
+local Ninja  = MBuild.Ninja;
+Ninja.Writer = Ninja.Writer or {};
+local Writer = Ninja.Writer;
+
+local function SortedKeys(tbl)
+	local keys = {};
+	for k, _ in pairs(tbl) do
+		table.insert(keys, k);
+	end
+	table.sort(keys);
+	return keys;
+end
+
+function Ninja.EscapePath(path)
+	return (path:gsub("%$", "$$"):gsub(" ", "$ "):gsub(":", "$:"));
+end
+
+function Ninja.EscapeValue(value)
+	return (value:gsub("%$", "$$"));
+end
+
+function Ninja.Quote(str)
+	if str:find("[%s\"']") then
+		return "\"" .. str:gsub("\"", "\\\"") .. "\"";
+	end
+	return str;
+end
+
+function Ninja.EscapePaths(paths)
+	local escaped = {};
+	for i, path in ipairs(paths) do
+		escaped[i] = Ninja.EscapePath(path);
+	end
+	return table.concat(escaped, " ");
+end
+
+function Writer:new()
+	local writer = {
+		lines   = {},
+		outputs = {}, -- Every file a build edge produces, phony targets aren't files
+		inputs  = {}, -- Every input of a build edge, including implicit and order only ones
+		stamps  = {}, -- Directories whose listing went into the build file, adding or removing an entry regenerates it
+		dyndeps = {}  -- Dyndep files written during the build, they declare outputs like module BMIs
+	};
+	setmetatable(writer, self);
+	self.__index = self;
+	return writer;
+end
+
+function Writer:Line(str)
+	table.insert(self.lines, str or "");
+end
+
+function Writer:Comment(str)
+	self:Line("# " .. str);
+end
+
+function Writer:Variable(name, value, indent)
+	self:Line(string.format("%s%s = %s", indent and "  " or "", name, value));
+end
+
+function Writer:Pool(name, depth)
+	self:Line("pool " .. name);
+	self:Variable("depth", tostring(depth), true);
+	self:Line();
+end
+
+function Writer:Rule(name, vars)
+	self:Line("rule " .. name);
+	for _, k in ipairs(SortedKeys(vars)) do
+		self:Variable(k, vars[k], true);
+	end
+	self:Line();
+end
+
+-- build = { outputs, rule, inputs, implicit, orderOnly, implicitOutputs, vars }
+function Writer:Build(build)
+	local str = Ninja.EscapePaths(build.outputs);
+	if build.implicitOutputs and #build.implicitOutputs > 0 then
+		str = str .. " | " .. Ninja.EscapePaths(build.implicitOutputs);
+	end
+	str = str .. ": " .. build.rule;
+	if build.inputs and #build.inputs > 0 then
+		str = str .. " " .. Ninja.EscapePaths(build.inputs);
+	end
+	if build.implicit and #build.implicit > 0 then
+		str = str .. " | " .. Ninja.EscapePaths(build.implicit);
+	end
+	if build.orderOnly and #build.orderOnly > 0 then
+		str = str .. " || " .. Ninja.EscapePaths(build.orderOnly);
+	end
+	self:Line("build " .. str);
+	for _, list in ipairs({ build.inputs or {}, build.implicit or {}, build.orderOnly or {} }) do
+		for _, input in ipairs(list) do
+			table.insert(self.inputs, input);
+		end
+	end
+	if build.rule ~= "phony" then
+		for _, output in ipairs(build.outputs) do
+			table.insert(self.outputs, output);
+		end
+		for _, output in ipairs(build.implicitOutputs or {}) do
+			table.insert(self.outputs, output);
+		end
+	end
+	if build.vars then
+		for _, k in ipairs(SortedKeys(build.vars)) do
+			self:Variable(k, build.vars[k], true);
+		end
+	end
+end
+
+function Writer:Default(paths)
+	self:Line("default " .. Ninja.EscapePaths(paths));
+end
+
+function Writer:ToString()
+	return table.concat(self.lines, "\n") .. "\n";
+end
+
+-- Only touches the file when its content changed, otherwise ninja would see a newer build.ninja and reload it
+function Writer:Save(path)
+	return MBuild.WriteFileIfChanged(path, self:ToString());
+end
+
+local function ScriptInputs()
+	local inputs = { fs.normalize(fs.absolute_script("Init.lua")) };
+	for path, _ in pairs(_G._MBuildImports or {}) do
+		table.insert(inputs, path);
+	end
+	table.sort(inputs);
+	return inputs;
+end
+
+local function AddToolchainRules(writer, toolchain)
+	if toolchain.info and toolchain.info.version then
+		writer:Comment(string.format("%s %s (%s)", toolchain.name, toolchain.info.version, toolchain.info.target or "unknown target"));
+	end
+	for _, tool in ipairs(SortedKeys(toolchain.tools)) do
+		writer:Variable(toolchain.prefix .. "_" .. tool, Ninja.EscapeValue(Ninja.Quote(toolchain.tools[tool])));
+	end
+	writer:Line();
+
+	for _, name in ipairs(SortedKeys(toolchain.rules)) do
+		local vars = {};
+		for k, v in pairs(toolchain.rules[name]) do
+			vars[k] = v:gsub("%$(%a+)", function(var)
+				if toolchain.tools[var] then
+					return "$" .. toolchain.prefix .. "_" .. var;
+				end
+				return "$" .. var;
+			end);
+		end
+		writer:Rule(toolchain.prefix .. "_" .. name, vars);
+	end
+end
+
+-- extension is the one of the source, some compilers need to be told its language
+function Ninja.CompileFlags(toolchain, configs, tool, extension)
+	local flags = {};
+	if extension and toolchain.languageFlags and toolchain.languageFlags[extension] then
+		table.insert(flags, toolchain.languageFlags[extension]);
+	end
+	if configs.warnings and toolchain.warnings[configs.warnings] then
+		table.insert(flags, toolchain.warnings[configs.warnings]);
+	end
+	if tool == "cxx" and configs.modules then
+		if not toolchain.modules then
+			error(string.format("'%s' doesn't support Modules()", toolchain.name));
+		end
+		table.insert(flags, toolchain.modules.flags);
+	end
+	if configs.splitDwarf and toolchain.splitDwarf then
+		table.insert(flags, toolchain.splitDwarf);
+	end
+	for _, dir in ipairs(configs.includeDirs or {}) do
+		table.insert(flags, string.format(toolchain.includeDir, Ninja.Quote(fs.normalize(fs.absolute(dir)))));
+	end
+	return Ninja.EscapeValue(table.concat(flags, " "));
+end
+
+-- Returns the ldflags of a link edge and the tool overrides of the selected linker
+function Ninja.LinkFlags(toolchain, project, configs)
+	local flags  = {};
+	local vars   = {};
+	local linker = MBuild.Toolchains.ResolveLinker(toolchain, configs.linker);
+	if linker and linker.flags then
+		table.insert(flags, linker.flags);
+	end
+	if linker and linker.tool then
+		vars[toolchain.prefix .. "_link"] = Ninja.EscapeValue(Ninja.Quote(linker.tool));
+	end
+	if configs.gdbIndex and toolchain.gdbIndex then
+		if not linker or not linker.gdbIndex then
+			error(string.format("Project '%s' requires Linker() to be 'Gold', 'LLD' or 'Mold' for GdbIndex()", project.name));
+		end
+		table.insert(flags, toolchain.gdbIndex);
+	end
+	vars.ldflags = Ninja.EscapeValue(table.concat(flags, " "));
+	return vars;
+end
+
+function Ninja.ProjectOutput(toolchain, project, configs)
+	if configs.kind == "StaticLib" then
+		return fs.normalize(fs.append(configs.binDir, toolchain.libPrefix .. project.name .. toolchain.libExt));
+	end
+	return fs.normalize(fs.append(configs.binDir, project.name .. toolchain.exeExt));
+end
+
+-- Compiles the project's PCHHeader with the C++ flags of the translation units that use it into pchDir
+function Ninja.GeneratePCH(writer, toolchain, project, configs, pchDir, flags, orderOnly)
+	local header = fs.normalize(configs.pchHeader);
+
+	if toolchain.pchFromSource then
+		if not configs.pchSource then
+			error(string.format("Project '%s' requires PCHSource() to use a precompiled header with '%s'", project.name, toolchain.name));
+		end
+
+		local source = fs.normalize(configs.pchSource);
+		local pch    = fs.append(pchDir, fs.filename(header) .. toolchain.pchExt);
+		local object = fs.append(pchDir, fs.filename(source) .. toolchain.objExt);
+		writer:Build({
+			outputs         = { object },
+			implicitOutputs = { pch },
+			rule            = toolchain.prefix .. "_pch",
+			inputs          = { source },
+			orderOnly       = orderOnly,
+			vars            = {
+				flags     = flags,
+				pchheader = Ninja.EscapeValue(Ninja.Quote(header)),
+				pch       = Ninja.EscapeValue(Ninja.Quote(pch))
+			}
+		});
+		return {
+			flags    = Ninja.EscapeValue(string.format(toolchain.pchUse, Ninja.Quote(header), Ninja.Quote(header), Ninja.Quote(pch))),
+			implicit = { pch },
+			object   = object,
+			source   = source
+		};
+	end
+
+	-- The compiler looks for '<wrapper>.gch' next to the forced include, so the real header is included through a wrapper
+	local wrapper = fs.append(pchDir, fs.filename(header));
+	local pch     = wrapper .. toolchain.pchExt;
+	MBuild.WriteFileIfChanged(wrapper, string.format("// This file is generated by MBuild, do not edit!\n#include \"%s\"\n", header));
+	writer:Build({
+		outputs   = { pch },
+		rule      = toolchain.prefix .. "_pch",
+		inputs    = { wrapper },
+		orderOnly = orderOnly,
+		vars      = { flags = flags }
+	});
+	return {
+		flags    = Ninja.EscapeValue(string.format(toolchain.pchUse, Ninja.Quote(wrapper))),
+		implicit = { pch }
+	};
+end
+
+-- Archives the binary and the RunDir of the project, the manifest holding the file list is only rewritten when the list changes.
+-- The file list is taken at configure time, so the RunDir directories regenerate the build file when files come or go
+function Ninja.GeneratePackage(writer, project, configs, objDir, binary)
+	local files, directories = MBuild.Package.Collect(project, configs, binary);
+	local manifest           = fs.append(objDir, "Package.lua");
+	MBuild.WriteFileIfChanged(manifest, MBuild.Serialize({ files = files }));
+	for _, directory in ipairs(directories) do
+		table.insert(writer.stamps, directory);
+	end
+
+	local inputs = {};
+	for i, file in ipairs(files) do
+		inputs[i] = file.path;
+	end
+	local archive = MBuild.Package.ArchivePath(project, configs);
+	writer:Build({
+		outputs  = { archive },
+		rule     = "package",
+		inputs   = inputs,
+		implicit = { manifest },
+		vars     = {
+			format   = configs.package,
+			manifest = Ninja.EscapeValue(Ninja.Quote(manifest))
+		}
+	});
+	return archive;
+end
+
+-- Generated files with these extensions have to exist before anything of the project compiles
+Ninja.headerExtensions = {
+	[".h"]   = true,
+	[".hh"]  = true,
+	[".hpp"] = true,
+	[".hxx"] = true,
+	[".inl"] = true
+};
+
+-- Evaluates ${...} in the strings with the same globals the configs are evaluated with, plus input for per input commands
+local function TransformStrings(strings, globals)
+	local orig = {};
+	for k, v in pairs(globals) do
+		orig[k] = _G[k];
+		_G[k]   = v;
+	end
+	local result = {};
+	for i, str in ipairs(strings) do
+		result[i] = MBuild:TransformString(str);
+	end
+	for k, _ in pairs(globals) do
+		_G[k] = orig[k];
+	end
+	return result;
+end
+
+local function AbsolutePaths(paths)
+	local result = {};
+	for i, path in ipairs(paths) do
+		result[i] = fs.normalize(fs.absolute(path));
+	end
+	return result;
+end
+
+local function CustomEdge(writer, custom, inputs, implicit, outputs, command)
+	writer:Build({
+		outputs  = outputs,
+		rule     = "custom",
+		inputs   = inputs,
+		implicit = implicit,
+		vars     = {
+			cmd  = Ninja.EscapeValue(command),
+			desc = Ninja.EscapeValue(custom.description or ("CUSTOM " .. fs.filename(outputs[1])))
+		}
+	});
+end
+
+-- Writes the edges of every CustomCommand() of the project, returns the generated sources to compile,
+-- the generated headers compiles have to wait for and every output
+function Ninja.GenerateCustomCommands(writer, toolchain, workspace, project, name, platform, objDir)
+	local entries = {};
+	for _, custom in ipairs(project.customCommands) do
+		table.insert(entries, { custom = custom, config = project.configMap[name][platform] });
+	end
+	for _, files in ipairs(project.files) do
+		for _, custom in ipairs(files.customCommands) do
+			table.insert(entries, { custom = custom, config = files.configMap[name][platform], paths = files.paths });
+		end
+	end
+
+	local result = { sources = {}, orderOnly = {}, outputs = {} };
+	local function AddOutputs(outputs, configs)
+		for _, output in ipairs(outputs) do
+			local extension = fs.extension(output);
+			local tool      = toolchain.extensions[extension];
+			if tool then
+				table.insert(result.sources, { path = output, tool = tool, configs = configs, flags = Ninja.CompileFlags(toolchain, configs, tool, extension), generated = true });
+			elseif Ninja.headerExtensions[extension] then
+				table.insert(result.orderOnly, output);
+			end
+			table.insert(result.outputs, output);
+		end
+	end
+
+	for index, entry in ipairs(entries) do
+		local custom  = entry.custom;
+		local config  = entry.config;
+		local globals = {
+			workspace     = workspace,
+			project       = project,
+			configuration = name,
+			platform      = platform,
+			architecture  = config.arch,
+			system        = config.system,
+			config        = config
+		};
+
+		local inputs, implicit;
+		if entry.paths then
+			inputs   = entry.paths;
+			implicit = AbsolutePaths(TransformStrings(custom.inputs, globals));
+		else
+			inputs   = AbsolutePaths(TransformStrings(custom.inputs, globals));
+			implicit = {};
+		end
+
+		if not custom:IsPerInput() then
+			local outputs = AbsolutePaths(TransformStrings(custom.outputs, globals));
+			local command = TransformStrings({ custom.command }, globals)[1];
+			CustomEdge(writer, custom, inputs, implicit, outputs, MBuild.CustomCommand.Expand(command, inputs, outputs));
+			AddOutputs(outputs, config.configs);
+		else
+			local perInput = {};
+			for i, path in ipairs(inputs) do
+				globals.input = {
+					path      = path,
+					name      = fs.filename(path),
+					stem      = fs.stem(path),
+					extension = fs.extension(path),
+					directory = fs.parent_path(path)
+				};
+				perInput[path] = {
+					outputs = AbsolutePaths(TransformStrings(custom.outputs, globals)),
+					command = TransformStrings({ custom.command }, globals)[1]
+				};
+				AddOutputs(perInput[path].outputs, config.configs);
+			end
+			globals.input = nil;
+
+			if custom.batch <= 1 then
+				for _, path in ipairs(inputs) do
+					local outputs = perInput[path].outputs;
+					CustomEdge(writer, custom, { path }, implicit, outputs, MBuild.CustomCommand.Expand(perInput[path].command, { path }, outputs));
+				end
+			else
+				-- Batches are split like unity batches, so adding an input only moves the inputs of its own batch
+				local sorted = MBuild.ShallowCopy(inputs);
+				table.sort(sorted);
+				for _, batch in ipairs(MBuild.Unity.Split(sorted, custom.batch)) do
+					local manifest = {
+						implicit = implicit,
+						inputs   = {}
+					};
+					local outputs  = {};
+					for _, path in ipairs(batch) do
+						table.insert(manifest.inputs, { path = path, outputs = perInput[path].outputs, command = perInput[path].command });
+						for _, output in ipairs(perInput[path].outputs) do
+							table.insert(outputs, output);
+						end
+					end
+
+					local manifestPath = fs.append(fs.append(objDir, "Custom"), string.format("Custom%d_%08x.lua", index, MBuild.Unity.Hash(batch[1]) % 0x100000000));
+					MBuild.WriteFileIfChanged(manifestPath, MBuild.Serialize(manifest));
+					local batchImplicit = { manifestPath, unpack(implicit) };
+					writer:Build({
+						outputs  = outputs,
+						rule     = "custom",
+						inputs   = batch,
+						implicit = batchImplicit,
+						vars     = {
+							cmd  = "$mbuild custom-batch " .. Ninja.EscapeValue(Ninja.Quote(manifestPath)),
+							desc = Ninja.EscapeValue(custom.description or string.format("CUSTOM %s (%d inputs)", fs.filename(outputs[1]), #batch))
+						}
+					});
+				end
+			end
+		end
+	end
+	return result;
+end
+
+function Ninja.GenerateProject(writer, workspace, project, name, platform, usedToolchains)
+	local config    = project.configMap[name][platform];
+	local toolchain = MBuild.Toolchains.ForConfig(config);
+	usedToolchains[toolchain.name] = toolchain;
+
+	if not config.configs.objDir or not config.configs.binDir then
+		error(string.format("Project '%s' requires ObjDir() and BinDir() to generate build files", project.name));
+	end
+
+	local location = fs.normalize(fs.absolute(project.evaluatedLocation));
+	local objDir   = fs.append(config.configs.objDir, project.name);
+
+	local sources = {};
+	local seen    = {};
+	for _, files in ipairs(project.files) do
+		local filesConfig = files.configMap[name][platform];
+		for _, path in ipairs(files.paths) do
+			local extension = fs.extension(path);
+			local tool      = toolchain.extensions[extension];
+			if tool then
+				-- Later Files() blocks override the configs of earlier ones
+				if not seen[path] then
+					seen[path] = #sources + 1;
+				end
+				sources[seen[path]] = { path = path, tool = tool, configs = filesConfig.configs, flags = Ninja.CompileFlags(toolchain, filesConfig.configs, tool, extension) };
+			end
+		end
+	end
+
+	writer:Comment(string.format("Project %s", project.name));
+	local objects = {};
+
+	local generated = Ninja.GenerateCustomCommands(writer, toolchain, workspace, project, name, platform, objDir);
+	for _, source in ipairs(generated.sources) do
+		if not seen[source.path] then
+			seen[source.path] = #sources + 1;
+			table.insert(sources, source);
+		end
+	end
+	local orderOnly = #generated.orderOnly > 0 and generated.orderOnly or nil;
+
+	if config.configs.pchHeader then
+		-- GCC and Clang silently skip a PCH built with other flags, so translation units whose Files() flags differ get their own
+		local projectFlags = Ninja.CompileFlags(toolchain, config.configs, "cxx");
+		local pchs         = {};
+		local function PCHFor(flags)
+			if not pchs[flags] then
+				local pchDir = flags == projectFlags and "PCH" or string.format("PCH-%s", fs.hash(flags):sub(1, 8));
+				pchs[flags] = Ninja.GeneratePCH(writer, toolchain, project, config.configs, fs.append(objDir, pchDir), flags, orderOnly);
+				if pchs[flags].object then
+					table.insert(objects, pchs[flags].object);
+				end
+			end
+			return pchs[flags];
+		end
+		local projectPCH = PCHFor(projectFlags);
+
+		local pchSources = {};
+		for _, source in ipairs(sources) do
+			if source.path ~= projectPCH.source then
+				if source.tool == "cxx" then
+					local flags = Ninja.CompileFlags(toolchain, source.configs, "cxx");
+					-- CL turns PCHSource into an object of the project, a second PCH of it would define its symbols twice
+					if flags == projectFlags or not toolchain.pchFromSource then
+						source.pch   = PCHFor(flags);
+						source.flags = source.flags .. " " .. source.pch.flags;
+					end
+				end
+				table.insert(pchSources, source);
+			end
+		end
+		sources = pchSources;
+	end
+	sources = MBuild.Unity.Batch(sources, fs.append(objDir, "Unity"));
+
+	-- Module units are compiled after the units providing their imports, the order comes from the collated scan results
+	local dyndep  = fs.append(objDir, "Modules.dd");
+	local scans   = {};
+	local modmaps = {};
+	for _, source in ipairs(sources) do
+		local object;
+		if source.members then
+			object = fs.normalize(source.path .. toolchain.objExt);
+		else
+			object = fs.normalize(fs.append(objDir, fs.relative(source.path, location) .. toolchain.objExt));
+		end
+		table.insert(objects, object);
+
+		local build = {
+			outputs   = { object },
+			rule      = toolchain.prefix .. "_" .. source.tool,
+			inputs    = { source.path },
+			implicit  = source.pch and source.pch.implicit,
+			orderOnly = orderOnly,
+			vars      = { flags = source.flags }
+		};
+		if source.tool == "cxx" and source.configs.modules then
+			local scan   = object .. ".ddi";
+			local modmap = object .. ".modmap";
+			writer:Build({
+				outputs   = { scan },
+				rule      = toolchain.prefix .. "_scan",
+				inputs    = { source.path },
+				implicit  = build.implicit,
+				orderOnly = orderOnly,
+				vars      = {
+					flags = source.flags,
+					obj   = Ninja.EscapeValue(Ninja.Quote(object))
+				}
+			});
+			table.insert(scans, scan);
+			table.insert(modmaps, modmap);
+
+			build.implicit    = { modmap, unpack(build.implicit or {}) };
+			build.orderOnly   = { dyndep, unpack(orderOnly or {}) };
+			build.vars.flags  = source.flags .. " " .. Ninja.EscapeValue(string.format(toolchain.modules.modmap, Ninja.Quote(modmap)));
+			build.vars.dyndep = Ninja.EscapeValue(dyndep);
+		end
+		writer:Build(build);
+	end
+	if #scans > 0 then
+		table.insert(writer.dyndeps, dyndep);
+		writer:Build({
+			outputs         = { dyndep },
+			implicitOutputs = modmaps,
+			rule            = "collate_modules",
+			inputs          = scans,
+			vars            = {
+				toolchain = Ninja.EscapeValue(Ninja.Quote(toolchain.name)),
+				bmidir    = Ninja.EscapeValue(Ninja.Quote(fs.append(objDir, "BMI")))
+			}
+		});
+	end
+
+	local binary = Ninja.ProjectOutput(toolchain, project, config.configs);
+	if config.configs.kind == "StaticLib" then
+		writer:Build({
+			outputs = { binary },
+			rule    = toolchain.prefix .. "_archive",
+			inputs  = objects
+		});
+	else
+		-- Libraries go after the objects, GNU linkers only pull in members for symbols that are already undefined
+		local inputs = objects;
+		for _, link in ipairs(config.configs.links or {}) do
+			local dependency;
+			for _, other in ipairs(workspace.projects) do
+				if other.name == link then
+					dependency = other;
+					break;
+				end
+			end
+			if not dependency then
+				error(string.format("Project '%s' links unknown project '%s'", project.name, link));
+			end
+			table.insert(inputs, Ninja.ProjectOutput(toolchain, dependency, dependency.configMap[name][platform].configs));
+		end
+		writer:Build({
+			outputs = { binary },
+			rule    = toolchain.prefix .. "_link",
+			inputs  = inputs,
+			vars    = Ninja.LinkFlags(toolchain, project, config.configs)
+		});
+	end
+	-- Outputs nothing compiles or links still belong to the project
+	local targets = { binary };
+	for _, output in ipairs(generated.outputs) do
+		table.insert(targets, output);
+	end
+	if config.configs.package and config.configs.package ~= "Off" then
+		table.insert(targets, Ninja.GeneratePackage(writer, project, config.configs, objDir, binary));
+	end
+	writer:Build({
+		outputs = { project.name },
+		rule    = "phony",
+		inputs  = targets
+	});
+	writer:Line();
+	return binary;
+end
+
+function Ninja.BuildFile(workspace, name, platform)
+	local config = workspace.configMap[name][platform];
+	if not config.configs.objDir then
+		error(string.format("Workspace '%s' requires ObjDir() to generate build files", workspace.name));
+	end
+	return fs.normalize(fs.append(config.configs.objDir, "build.ninja"));
+end
+
+function Ninja.GenerateConfiguration(workspace, name, platform)
+	local buildFile = Ninja.BuildFile(workspace, name, platform);
+
+	local body           = Writer:new();
+	local usedToolchains = {};
+	local defaults       = {};
+	for _, project in ipairs(workspace.projects) do
+		table.insert(defaults, project.name);
+		Ninja.GenerateProject(body, workspace, project, name, platform, usedToolchains);
+	end
+
+	local writer = Writer:new();
+	writer:Comment("This file is generated by MBuild, do not edit!");
+	writer:Comment(string.format("Workspace %s, configuration %s, platform %s", workspace.name, name, platform));
+	writer:Variable("ninja_required_version", "1.10");
+	writer:Variable("builddir", Ninja.EscapeValue(fs.parent_path(buildFile)));
+	writer:Line();
+
+	writer:Variable("mbuild", Ninja.EscapeValue(Ninja.MBuildCommand()));
+	writer:Line();
+
+	writer:Pool("link_pool", Ninja.linkPoolDepth);
+
+	for _, toolchainName in ipairs(SortedKeys(usedToolchains)) do
+		AddToolchainRules(writer, usedToolchains[toolchainName]);
+	end
+
+	writer:Rule("custom", {
+		command     = "$cmd",
+		description = "$desc",
+		restat      = "1"
+	});
+	writer:Rule("collate_modules", {
+		command     = "$mbuild collate-modules $toolchain $out $bmidir $in",
+		description = "MODULES $out",
+		restat      = "1"
+	});
+	writer:Rule("package", {
+		command     = "$mbuild package $format $out $manifest",
+		description = "PACKAGE $out"
+	});
+	writer:Rule("regenerate", {
+		command     = "$mbuild",
+		description = "Regenerating build files",
+		generator   = "1",
+		restat      = "1",
+		pool        = "console"
+	});
+	local regenerateInputs = ScriptInputs();
+	for _, stamp in ipairs(body.stamps) do
+		table.insert(regenerateInputs, stamp);
+	end
+	writer:Build({
+		outputs  = { buildFile },
+		rule     = "regenerate",
+		implicit = regenerateInputs
+	});
+	writer:Line();
+
+	for _, line in ipairs(body.lines) do
+		writer:Line(line);
+	end
+	for _, output in ipairs(body.outputs) do
+		table.insert(writer.outputs, output);
+	end
+	for _, input in ipairs(body.inputs) do
+		table.insert(writer.inputs, input);
+	end
+	writer:Default(defaults);
+
+	writer:Save(buildFile);
+	return buildFile, { outputs = writer.outputs, inputs = writer.inputs, dyndeps = body.dyndeps };
+end
+
+-- MBuild finds its scripts relative to the working directory, so every invocation from ninja starts with changing into it
+function Ninja.MBuildCommand()
+	local cwd = fs.current_path();
+	if os.host() == "windows" then
+		return string.format("cmd /c cd /d %s && %s", Ninja.Quote(cwd), Ninja.Quote(os.executable()));
+	end
+	return string.format("cd %s && %s", Ninja.Quote(cwd), Ninja.Quote(os.executable()));
+end
+
+-- --jobs=N, otherwise the parallelism ninja picks without -j
+function Ninja.Jobs()
+	local jobs = tonumber(MBuild.options.jobs or "");
+	if jobs and jobs >= 1 then
+		return math.floor(jobs);
+	end
+	local threads = os.cpu().threads;
+	if threads <= 1 then
+		return 2;
+	elseif threads == 2 then
+		return 3;
+	end
+	return threads + 2;
+end
+
+-- Runs ninja, --ninja=<path> or the one in PATH, on the targets of buildFile with the extra flags and returns its exit code
+function Ninja.Run(buildFile, jobs, targets, flags)
+	local ninja = MBuild.options.ninja or MBuild.Probe.FindExecutable("ninja");
+	if not ninja then
+		print("Failed to find ninja in PATH, pass it with --ninja=<path>");
+		return 1;
+	end
+	local command = { MBuild.ShellQuote(ninja), "-f", MBuild.ShellQuote(buildFile), "-j", tostring(jobs) };
+	for _, flag in ipairs(flags or {}) do
+		table.insert(command, flag);
+	end
+	for _, target in ipairs(targets or {}) do
+		table.insert(command, MBuild.ShellQuote(target));
+	end
+	return MBuild.Execute(table.concat(command, " "));
+end
+
+-- Returns the build files and the { outputs, inputs } of each of them
+function Ninja.GenerateWorkspace(workspace)
+	local buildFiles = {};
+	local contents   = {};
+	for _, name in ipairs(workspace.configurations) do
+		for _, platform in ipairs(workspace.platforms) do
+			local buildFile, content = Ninja.GenerateConfiguration(workspace, name, platform);
+			table.insert(buildFiles, buildFile);
+			table.insert(contents, content);
+		end
+	end
+	return buildFiles, contents;
+end
\ No newline at end of file
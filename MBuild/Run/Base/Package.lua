@@ -0,0 +1,226 @@
+-- Packaging of project outputs, the build files run this through "mbuild package".
+-- The archive is streamed straight from the outputs into the compressor, entries are sorted and carry fixed owners and
+-- times, so the same inputs always produce the same archive.
+MBuild.Package = MBuild.Package or {
+	formats = {
+		Tar     = { extension = ".tar" },
+		TarZstd = { extension = ".tar.zst", compressor = "zstd", arguments = "-T0 -q -f -o %s" }
+	},
+	chunkSize = 1024 * 1024
+};
+
+local Package = MBuild.Package;
+
+function Package.ArchivePath(project, configs)
+	return fs.normalize(fs.append(configs.binDir, project.name .. Package.formats[configs.package].extension));
+end
+
+local function CollectRunDir(dir, prefix, entries, directories)
+	local listing = MBuild.Files.ListDirectory(dir);
+	if not listing then
+		return;
+	end
+	table.insert(directories, dir:sub(1, -2));
+	for _, name in ipairs(listing.files) do
+		table.insert(entries, { name = prefix .. name, path = dir .. name });
+	end
+	for _, name in ipairs(listing.dirs) do
+		CollectRunDir(dir .. name .. "/", prefix .. name .. "/", entries, directories);
+	end
+end
+
+-- Returns the archive entries of a project, the binary at the root followed by everything in RunDir, sorted by name,
+-- and the directories of RunDir that were listed for them
+function Package.Collect(project, configs, binary)
+	local entries     = {};
+	local directories = {};
+	if configs.runDir then
+		local dir = configs.runDir:gsub("\\", "/");
+		if dir:sub(-1) ~= "/" then
+			dir = dir .. "/";
+		end
+		CollectRunDir(dir, project.name .. "/", entries, directories);
+	end
+
+	local archive = Package.ArchivePath(project, configs);
+	local seen    = { [project.name .. "/" .. fs.filename(binary)] = true };
+	local result  = { { name = project.name .. "/" .. fs.filename(binary), path = binary } };
+	for _, entry in ipairs(entries) do
+		-- The binary takes precedence over a RunDir file of the same name and an archive inside RunDir mustn't package itself
+		if not seen[entry.name] and fs.normalize(entry.path) ~= archive then
+			seen[entry.name] = true;
+			table.insert(result, entry);
+		end
+	end
+	table.sort(result, function(a, b) return a.name < b.name; end);
+	return result, directories;
+end
+
+local function Octal(value, width)
+	return string.format("%0" .. (width - 1) .. "o", value) .. "\0";
+end
+
+local function Field(str, width)
+	return str:sub(1, width) .. string.rep("\0", width - math.min(#str, width));
+end
+
+-- Splits a name at a '/' into the 155 byte prefix and the 100 byte name of a ustar header, nil when it doesn't fit
+local function SplitName(name)
+	if #name <= 100 then
+		return "", name;
+	end
+	local prefix = name:sub(1, 156):match("^(.*)/");
+	if prefix and #name - #prefix - 1 <= 100 then
+		return prefix, name:sub(#prefix + 2);
+	end
+	return nil;
+end
+
+-- ustar header, the checksum is computed with the checksum field set to spaces
+local function TarHeader(prefix, name, size, mode, typeflag, mtime)
+	local header = table.concat({
+		Field(name, 100),
+		Octal(mode, 8),
+		Octal(0, 8),
+		Octal(0, 8),
+		Octal(size, 12),
+		Octal(mtime, 12),
+		"        ",
+		typeflag,
+		Field("", 100),
+		"ustar\0",
+		"00",
+		Field("", 32),
+		Field("", 32),
+		Octal(0, 8),
+		Octal(0, 8),
+		Field(prefix, 155),
+		Field("", 12)
+	});
+	local sum = 0;
+	for i = 1, #header do
+		sum = sum + header:byte(i);
+	end
+	return header:sub(1, 148) .. string.format("%06o", sum) .. "\0 " .. header:sub(157);
+end
+
+local function Padding(size)
+	return string.rep("\0", (512 - size % 512) % 512);
+end
+
+-- A pax record is "<length> <key>=<value>\n" where length counts the whole record including its own digits
+local function PaxRecord(key, value)
+	local body   = " " .. key .. "=" .. value .. "\n";
+	local length = #body;
+	while #body + #tostring(length) ~= length do
+		length = #body + #tostring(length);
+	end
+	return tostring(length) .. body;
+end
+
+local function WriteEntry(out, entry, mtime)
+	local suc, buffer = fs.read(entry.path);
+	if not suc then
+		error(buffer, 0);
+	end
+	local size = buffer:size();
+
+	local mode  = 420; -- 0644
+	local _, st = fs.status(entry.path);
+	if type(st) == "table" and st.permissions and st.permissions:find("X", 1, true) then
+		mode = 493; -- 0755
+	end
+
+	-- Names that don't fit ustar and sizes of 8 GiB and above go into a pax extended header
+	local pax          = {};
+	local prefix, name = SplitName(entry.name);
+	if not prefix then
+		table.insert(pax, PaxRecord("path", entry.name));
+		prefix, name = "", entry.name;
+	end
+	if size >= 8 ^ 11 then
+		table.insert(pax, PaxRecord("size", string.format("%.0f", size)));
+	end
+	if #pax > 0 then
+		local records = table.concat(pax);
+		out:write(TarHeader("", "PaxHeaders/" .. fs.filename(entry.name), #records, mode, "x", mtime), records, Padding(#records));
+	end
+
+	out:write(TarHeader(prefix, name, size < 8 ^ 11 and size or 0, mode, "0", mtime));
+	for first = 1, size, Package.chunkSize do
+		out:write(buffer:sub(first, first + Package.chunkSize - 1));
+	end
+	out:write(Padding(size));
+	buffer:close();
+end
+
+-- Writes the archive of a manifest to output through a temporary file, so an interrupted run never leaves a truncated archive
+function Package.Write(format, output, manifestPath)
+	local info = Package.formats[format];
+	if not info then
+		printf("Unknown package format '%s'", format);
+		return 1;
+	end
+	local manifest = MBuild.Deserialize(manifestPath);
+	if not manifest then
+		printf("Failed to load package manifest '%s'", manifestPath);
+		return 1;
+	end
+
+	local temp = output .. ".tmp";
+	os.remove(temp);
+	fs.create_directories(fs.parent_path(output));
+
+	local out;
+	if info.compressor then
+		-- Checked up front, writing into the pipe of a missing compressor would kill the process with SIGPIPE
+		local compressor = MBuild.Probe.FindExecutable(info.compressor);
+		if not compressor then
+			printf("Failed to package '%s', '%s' wasn't found in PATH", output, info.compressor);
+			return 1;
+		end
+		local command = MBuild.ShellQuote(compressor) .. " " .. string.format(info.arguments, MBuild.ShellQuote(temp));
+		out           = io.popen(command, os.host() == "windows" and "wb" or "w");
+	else
+		out = io.open(temp, "wb");
+	end
+	if not out then
+		printf("Failed to open '%s' for writing", temp);
+		return 1;
+	end
+
+	-- SOURCE_DATE_EPOCH is the usual way to pin the time of reproducible artifacts
+	local mtime    = tonumber(os.getenv("SOURCE_DATE_EPOCH") or "") or 0;
+	local suc, err = pcall(function()
+		for _, entry in ipairs(manifest.files) do
+			WriteEntry(out, entry, mtime);
+		end
+		out:write(string.rep("\0", 1024));
+	end);
+	out:close();
+	if not suc then
+		os.remove(temp);
+		printf("Failed to package '%s': %s", output, tostring(err));
+		return 1;
+	end
+	if not fs.is_regular_file(temp) then
+		printf("Failed to package '%s', '%s' didn't write '%s'", output, tostring(info.compressor), temp);
+		return 1;
+	end
+
+	local renamed, renameErr = fs.rename(temp, output);
+	if not renamed then
+		printf("Failed to replace '%s': %s", output, tostring(renameErr));
+		return 1;
+	end
+	return 0;
+end
+
+-- package <format> <out> <manifest>
+MBuild.RegisterCommand("package", function(self, args)
+	if #args ~= 3 then
+		print("Usage: mbuild package <format> <out> <manifest>");
+		return 1;
+	end
+	return Package.Write(args[1], args[2], args[3]);
+end);
\ No newline at end of file
@@ -0,0 +1,128 @@
+MBuild.Probe = MBuild.Probe or {
+	cache = nil
+};
+
+local Probe = MBuild.Probe;
+
+function Probe.CachePath()
+	return fs.append(MBuild.CacheDir(), "Toolchains.lua");
+end
+
+function Probe.FindExecutable(name)
+	if name:find("[/\\]") then
+		return fs.normalize(fs.absolute(name));
+	end
+
+	local isWindows = os.host() == "windows";
+	for dir in (os.getenv("PATH") or ""):gmatch(isWindows and "[^;]+" or "[^:]+") do
+		local path = fs.append(dir, name);
+		if fs.is_regular_file(path) then
+			return fs.normalize(path);
+		end
+		if isWindows and fs.is_regular_file(path .. ".exe") then
+			return fs.normalize(path .. ".exe");
+		end
+	end
+	return nil;
+end
+
+-- Identifies a compiler binary without running it
+function Probe.Stamp(path)
+	local suc, mtime = fs.mtime_ns(path);
+	if not suc then
+		return nil;
+	end
+	local suc2, size = fs.file_size(path);
+	if not suc2 then
+		return nil;
+	end
+	return { mtime = mtime, size = size };
+end
+
+function Probe.Parse(toolchain, output)
+	local probe  = toolchain.probe;
+	local result = {
+		version     = output:match(probe.version),
+		target      = output:match(probe.target),
+		includeDirs = {}
+	};
+
+	if probe.includeStart then
+		local inIncludes = false;
+		for line in output:gmatch("[^\r\n]+") do
+			if line == probe.includeEnd then
+				break;
+			elseif inIncludes then
+				table.insert(result.includeDirs, fs.normalize((line:gsub("^%s+", ""):gsub(" %(framework directory%)$", ""))));
+			elseif line == probe.includeStart then
+				inIncludes = true;
+			end
+		end
+	else
+		for dir in (os.getenv("INCLUDE") or ""):gmatch("[^;]+") do
+			table.insert(result.includeDirs, fs.normalize(dir));
+		end
+	end
+	return result;
+end
+
+function Probe.LoadCache()
+	if not Probe.cache then
+		Probe.cache = MBuild.Deserialize(Probe.CachePath()) or {};
+	end
+	return Probe.cache;
+end
+
+-- Resolves toolchain.info for every toolchain, only spawning compilers whose binary changed since the cached probe.
+-- Missing probes are all started before any output is read, so they run in parallel.
+function Probe.ProbeToolchains(toolchains)
+	local cache   = Probe.LoadCache();
+	local pending = {};
+	local names   = {};
+	for name, _ in pairs(toolchains) do
+		table.insert(names, name);
+	end
+	table.sort(names);
+
+	for _, name in ipairs(names) do
+		local toolchain = toolchains[name];
+		local path      = Probe.FindExecutable(toolchain.tools.cxx);
+		local stamp     = path and Probe.Stamp(path);
+		if not stamp then
+			toolchain.info = { path = toolchain.tools.cxx, includeDirs = {} };
+		else
+			local cached = cache[path];
+			if cached and cached.mtime == stamp.mtime and cached.size == stamp.size then
+				toolchain.info = cached;
+			else
+				local command = string.format("\"%s\" %s < %s 2>&1", path, toolchain.probe.args, os.host() == "windows" and "NUL" or "/dev/null");
+				table.insert(pending, {
+					toolchain = toolchain,
+					path      = path,
+					stamp     = stamp,
+					handle    = io.popen(command, "r")
+				});
+			end
+		end
+	end
+
+	if #pending == 0 then
+		return;
+	end
+
+	for _, probe in ipairs(pending) do
+		local output = "";
+		if probe.handle then
+			output = probe.handle:read("*a") or "";
+			probe.handle:close();
+		end
+
+		local info           = Probe.Parse(probe.toolchain, output);
+		info.path            = probe.path;
+		info.mtime           = probe.stamp.mtime;
+		info.size            = probe.stamp.size;
+		cache[probe.path]    = info;
+		probe.toolchain.info = info;
+	end
+	MBuild.WriteFileIfChanged(Probe.CachePath(), MBuild.Serialize(cache));
+end
\ No newline at end of file
@@ -0,0 +1,107 @@
+-- Sampling profiler for the configure scripts, enabled with --profile-lua[=output].
+-- Writes collapsed stacks ("frame;frame;frame count" per line) which flamegraph.pl, speedscope and inferno can read.
+MBuild.Profile = MBuild.Profile or {
+	interval = 1, -- Milliseconds between samples
+	depth    = 64,
+	stacks   = {},
+	samples  = 0,
+	running  = false
+};
+
+local Profile = MBuild.Profile;
+
+-- Samples taken outside of Lua code are attributed to a pseudo frame on top of the Lua stack
+local vmStates = {
+	C = "[C]",
+	G = "[GC]",
+	J = "[JIT compiler]"
+};
+
+-- Imported scripts are loaded through their absolute path, strip the working directory so frames stay readable
+local function ShortenFrames(stack, prefix)
+	if #prefix == 0 then
+		return stack;
+	end
+	local parts = {};
+	for frame in stack:gmatch("[^;]+") do
+		if frame:sub(1, #prefix) == prefix then
+			frame = frame:sub(#prefix + 1);
+		end
+		table.insert(parts, frame);
+	end
+	return table.concat(parts, ";");
+end
+
+function Profile.Start(output)
+	local hasProfile, profile = pcall(require, "jit.profile");
+	if not hasProfile then
+		print("--profile-lua requires LuaJIT with jit.profile, profiling is disabled");
+		return false;
+	end
+
+	Profile.output  = output;
+	Profile.stacks  = {};
+	Profile.samples = 0;
+	Profile.running = true;
+	Profile.module  = profile;
+
+	local stacks = Profile.stacks;
+	local depth  = -Profile.depth;
+	profile.start("li" .. tostring(Profile.interval), function(thread, samples, vmstate)
+		-- Negative depth dumps the outermost frame first, as collapsed stacks expect
+		local stack = profile.dumpstack(thread, "pl;", depth):gsub(";$", "");
+		if vmStates[vmstate] then
+			stack = stack .. ";" .. vmStates[vmstate];
+		end
+		stacks[stack]   = (stacks[stack] or 0) + samples;
+		Profile.samples = Profile.samples + samples;
+	end);
+	return true;
+end
+
+function Profile.Stop()
+	if not Profile.running then
+		return nil;
+	end
+	Profile.module.stop();
+	Profile.running = false;
+
+	local prefix = fs.normalize(fs.current_path() .. "/");
+	local merged = {};
+	for stack, count in pairs(Profile.stacks) do
+		local short   = ShortenFrames(stack, prefix);
+		merged[short] = (merged[short] or 0) + count;
+	end
+
+	local keys = {};
+	for stack, _ in pairs(merged) do
+		table.insert(keys, stack);
+	end
+	table.sort(keys);
+
+	local lines = {};
+	for _, stack in ipairs(keys) do
+		table.insert(lines, string.format("%s %d", stack, merged[stack]));
+	end
+
+	fs.create_directories(fs.parent_path(Profile.output));
+	local file = io.open(Profile.output, "wb");
+	if not file then
+		print(string.format("Failed to write Lua profile '%s'", Profile.output));
+		return nil;
+	end
+	file:write(table.concat(lines, "\n"), "\n");
+	file:close();
+	printf("Lua profile with %d samples written to '%s'", Profile.samples, Profile.output);
+	return Profile.output;
+end
+
+local output = MBuild.options["profile-lua"];
+if output and not Profile.running then
+	if output == true then
+		output = fs.append(MBuild.CacheDir(), "Profile.folded");
+	end
+	if Profile.Start(fs.normalize(fs.absolute(output))) then
+		MBuild.OnFinish(Profile.Stop);
+	end
+end
\ No newline at end of file
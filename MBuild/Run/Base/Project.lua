@@ -8,6 +8,8 @@ function Project:new(name, callback)
 		files    = {},
 		whens    = {},
 
+		customCommands = {},
+
 		location  = "./",
 		configs   = {},
 		configMap = {}
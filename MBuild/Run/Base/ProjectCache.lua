@@ -0,0 +1,471 @@
+-- Incremental reconfigure, a project whose inputs are unchanged since the last run is restored from .mbuild/Projects instead
+-- of running its callback and evaluating its configs again. Files() blocks are still expanded every run, the glob cache
+-- makes that cheap. The inputs of a project are
+--   - the Base scripts and the MBuild executable,
+--   - the workspace configs it extends and the globals the main script defined,
+--   - the source of its callback and the values the callback captured,
+--   - the scripts imported and the fs and environment queries made while it was configured.
+-- Callbacks are assumed to only describe their project, one that writes files or runs commands while configured is never cached.
+-- --reconfigure ignores the cache and configures every project again.
+MBuild.ProjectCache = MBuild.ProjectCache or {
+	version  = 1,
+	maxDepth = 16,  -- Nesting of captured values and functions followed for a fingerprint
+	recorder = nil, -- Dependencies of the project being configured
+	globals  = nil, -- Globals before the main script ran, set by SnapshotGlobals
+
+	-- Globals MBuild itself assigns while configuring
+	ignoredGlobals = {
+		workspace = true, project = true, files = true, when = true, config = true,
+		configuration = true, platform = true, architecture = true, system = true
+	},
+
+	-- Queries recorded while a project is configured, every one is repeated on the next run and has to return the same
+	queries = {
+		fs = {
+			"exists", "is_directory", "is_regular_file", "is_symlink", "is_empty", "file_size", "last_write_time",
+			"status", "symlink_status", "read_symlink", "hash_file", "mtime_ns"
+		},
+		os = { "getenv" }
+	},
+
+	-- Functions with side effects a restored project wouldn't repeat, a project calling one of them is never cached
+	sideEffects = {
+		fs     = {
+			"write_if_changed", "remove", "remove_all", "remove_trees", "rename", "copy", "copy_file", "copy_symlink",
+			"create_directory", "create_directories", "create_hardlink", "create_symlink", "create_directory_symlink"
+		},
+		io     = { "popen" },
+		os     = { "execute", "remove", "rename" },
+		MBuild = { "Execute", "WriteFileIfChanged" }
+	}
+};
+
+local ProjectCache = MBuild.ProjectCache;
+
+function ProjectCache.Dir()
+	return fs.append(MBuild.CacheDir(), "Projects");
+end
+
+function ProjectCache.EntryPath(workspace, project)
+	return fs.append(ProjectCache.Dir(), fs.hash(workspace.name .. "\0" .. project.name) .. ".lua");
+end
+
+-- Globals defined by Base, anything else the main script defines or changes is part of every fingerprint
+function ProjectCache.SnapshotGlobals()
+	if ProjectCache.globals then
+		return;
+	end
+	ProjectCache.globals   = {};
+	ProjectCache.libraries = {};
+	for k, v in pairs(_G) do
+		ProjectCache.globals[k] = v;
+		if type(v) == "table" then
+			ProjectCache.libraries[v] = tostring(k);
+		end
+	end
+end
+
+local baseDir     = fs.parent_path(fs.normalize(fs.absolute_script("Init.lua")));
+local sourceLines = {};
+
+-- Lines first..last of a chunk, last 0 means up to the end
+local function SourceText(source, first, last)
+	local lines = sourceLines[source];
+	if not lines then
+		local content = source;
+		if source:sub(1, 1) == "@" then
+			content = MBuild.ReadFile(source:sub(2));
+			if not content then
+				return nil;
+			end
+		end
+		lines = {};
+		for line in (content .. "\n"):gmatch("([^\n]*)\n") do
+			table.insert(lines, line);
+		end
+		sourceLines[source] = lines;
+	end
+	if first <= 0 then
+		return table.concat(lines, "\n");
+	end
+	return table.concat(lines, "\n", first, math.min(last, #lines));
+end
+
+-- A string that changes whenever value would behave differently, nil for values that can't be captured
+local Signature;
+
+local function FunctionSignature(fn, depth, seen)
+	local info = debug.getinfo(fn, "S");
+	if info.what == "C" then
+		return "C";
+	end
+
+	local text;
+	if info.source:sub(1, 1) == "@" and fs.parent_path(fs.normalize(info.source:sub(2))) == baseDir then
+		-- Base scripts are part of every fingerprint already
+		text = string.format("base %s:%d", info.source, info.linedefined);
+	else
+		text = SourceText(info.source, info.linedefined, info.lastlinedefined);
+		if not text then
+			return nil;
+		end
+	end
+
+	local parts = { text };
+	local i     = 1;
+	while true do
+		local name, value = debug.getupvalue(fn, i);
+		if not name then
+			break;
+		end
+		local signature = Signature(value, depth + 1, seen);
+		if not signature then
+			return nil;
+		end
+		table.insert(parts, name .. "=" .. signature);
+		i = i + 1;
+	end
+	return "function(" .. table.concat(parts, "\n") .. ")";
+end
+
+Signature = function(value, depth, seen)
+	local vtype = type(value);
+	if vtype == "nil" or vtype == "boolean" then
+		return tostring(value);
+	elseif vtype == "number" then
+		return string.format("%.17g", value);
+	elseif vtype == "string" then
+		return string.format("%q", value);
+	elseif vtype == "cdata" and tostring(value):match("^%-?%d+U?LL$") then
+		return tostring(value);
+	elseif (vtype ~= "table" and vtype ~= "function") or depth > ProjectCache.maxDepth then
+		return nil;
+	elseif ProjectCache.libraries and ProjectCache.libraries[value] then
+		return "library " .. ProjectCache.libraries[value];
+	elseif seen[value] then
+		return "cycle";
+	end
+
+	seen[value] = true;
+	local signature;
+	if vtype == "function" then
+		signature = FunctionSignature(value, depth, seen);
+	else
+		local entries = {};
+		for k, v in pairs(value) do
+			local key, val = Signature(k, depth + 1, seen), Signature(v, depth + 1, seen);
+			if not key or not val then
+				seen[value] = nil;
+				return nil;
+			end
+			table.insert(entries, key .. "=" .. val);
+		end
+		table.sort(entries);
+		signature = "{" .. table.concat(entries, ",") .. "}";
+	end
+	seen[value] = nil;
+	return signature;
+end
+
+function ProjectCache.Signature(value)
+	return Signature(value, 0, {});
+end
+
+local function ExecutableStamp()
+	local _, time = fs.mtime_ns(os.executable());
+	local _, size = fs.file_size(os.executable());
+	return tostring(time) .. ":" .. tostring(size);
+end
+
+local function BaseHash()
+	if not ProjectCache.baseHash then
+		local parts   = { ExecutableStamp() };
+		local listing = MBuild.Files.ListDirectory(baseDir .. "/") or { files = {} };
+		for _, name in ipairs(listing.files) do
+			local _, hash = fs.hash_file(fs.append(baseDir, name));
+			table.insert(parts, name .. "=" .. tostring(hash));
+		end
+		ProjectCache.baseHash = fs.hash(table.concat(parts, "\n"));
+	end
+	return ProjectCache.baseHash;
+end
+
+-- The part of the fingerprint shared by the projects of a workspace, nil when its inputs can't be captured
+function ProjectCache.WorkspaceFingerprint(workspace)
+	if MBuild.options.reconfigure or not ProjectCache.globals then
+		return nil;
+	end
+
+	local names = {};
+	for k, v in pairs(_G) do
+		if type(k) ~= "string" then
+			return nil;
+		end
+		if not ProjectCache.ignoredGlobals[k] and not rawequal(ProjectCache.globals[k], v) then
+			table.insert(names, k);
+		end
+	end
+	table.sort(names);
+
+	local parts = { tostring(ProjectCache.version), BaseHash(), workspace.name, workspace.location };
+	for _, name in ipairs(names) do
+		local signature = ProjectCache.Signature(_G[name]);
+		if not signature then
+			return nil;
+		end
+		table.insert(parts, name .. "=" .. signature);
+	end
+	local configMap = ProjectCache.Signature(workspace.configMap);
+	if not configMap then
+		return nil;
+	end
+	table.insert(parts, configMap);
+	return fs.hash(table.concat(parts, "\n"));
+end
+
+-- Runs fn with the queries of the project recorded, a project can be recorded several times and keeps all of them
+function ProjectCache.Record(project, fn)
+	local recorder = project.cacheRecord or { scripts = {}, queries = {}, cacheable = true };
+	project.cacheRecord   = recorder;
+	ProjectCache.recorder = recorder;
+
+	local originals = {};
+	local function Wrap(lib, name, wrapper)
+		table.insert(originals, { lib = lib, name = name, fn = lib[name] });
+		lib[name] = wrapper;
+	end
+	local function Query(libName, name, args)
+		local argsSignature = ProjectCache.Signature(args);
+		if not argsSignature then
+			recorder.cacheable = false;
+			return;
+		end
+		local key = libName .. "." .. name .. argsSignature;
+		if not recorder.queries[key] then
+			recorder.queries[key] = { lib = libName, name = name, args = args };
+		end
+	end
+
+	for libName, names in pairs(ProjectCache.queries) do
+		local lib = _G[libName];
+		for _, name in ipairs(names) do
+			local original = lib[name];
+			Wrap(lib, name, function(...)
+				Query(libName, name, { ... });
+				return original(...);
+			end);
+		end
+	end
+	-- Reads depend on the content, listings on the stamp of the directory
+	local read = fs.read;
+	Wrap(fs, "read", function(path, ...)
+		Query("fs", "hash_file", { path });
+		return read(path, ...);
+	end);
+	local open = io.open;
+	Wrap(io, "open", function(path, mode, ...)
+		-- "r+" writes as well, only plain reads are queries
+		if mode == nil or not mode:find("[wa+]") then
+			Query("fs", "hash_file", { path });
+		else
+			recorder.cacheable = false;
+		end
+		return open(path, mode, ...);
+	end);
+	local iterator = fs.directory_iterator;
+	Wrap(fs, "directory_iterator", function(path, ...)
+		Query("fs", "directory_stamp", { path });
+		return iterator(path, ...);
+	end);
+	local recursiveIterator = fs.recursive_directory_iterator;
+	Wrap(fs, "recursive_directory_iterator", function(...)
+		recorder.cacheable = false;
+		return recursiveIterator(...);
+	end);
+
+	for libName, names in pairs(ProjectCache.sideEffects) do
+		local lib = _G[libName];
+		for _, name in ipairs(names) do
+			local original = lib[name];
+			if original then
+				Wrap(lib, name, function(...)
+					recorder.cacheable = false;
+					return original(...);
+				end);
+			end
+		end
+	end
+
+	local suc, err = pcall(fn);
+
+	for i = #originals, 1, -1 do
+		originals[i].lib[originals[i].name] = originals[i].fn;
+	end
+	ProjectCache.recorder = nil;
+	if not suc then
+		error(err, 0);
+	end
+end
+
+-- Called by import() and include() for every script they load
+function ProjectCache.OnScript(path)
+	if ProjectCache.recorder then
+		ProjectCache.recorder.scripts[path] = true;
+	end
+end
+
+local function QueryResult(query)
+	local lib = _G[query.lib];
+	if not lib or not lib[query.name] then
+		return nil;
+	end
+	return ProjectCache.Signature({ pcall(lib[query.name], unpack(query.args)) });
+end
+
+local function IsCurrent(entry, fingerprint)
+	if type(entry) ~= "table" or entry.version ~= ProjectCache.version or entry.fingerprint ~= fingerprint then
+		return false;
+	end
+	for path, hash in pairs(entry.scripts) do
+		local suc, current = fs.hash_file(path);
+		if not suc or current ~= hash then
+			return false;
+		end
+	end
+	for _, query in ipairs(entry.queries) do
+		if QueryResult(query) ~= query.result then
+			return false;
+		end
+	end
+	return true;
+end
+
+local function SaveConfigMap(configMap)
+	local saved = {};
+	for name, arr in pairs(configMap) do
+		saved[name] = {};
+		for platform, config in pairs(arr) do
+			saved[name][platform] = { arch = config.arch, system = config.system, configs = config.configs };
+		end
+	end
+	return saved;
+end
+
+local function RestoreConfigMap(saved)
+	local configMap = {};
+	for name, arr in pairs(saved) do
+		configMap[name] = {};
+		for platform, data in pairs(arr) do
+			local config  = MBuild.Config:new(name, platform, data.configs);
+			config.arch   = data.arch;
+			config.system = data.system;
+			configMap[name][platform] = config;
+		end
+	end
+	return configMap;
+end
+
+local function SaveCustomCommands(customCommands)
+	local saved = {};
+	for i, custom in ipairs(customCommands) do
+		saved[i] = { inputs = custom.inputs, outputs = custom.outputs, command = custom.command, description = custom.description, batch = custom.batch };
+	end
+	return saved;
+end
+
+local function RestoreCustomCommands(saved)
+	local customCommands = {};
+	for i, settings in ipairs(saved) do
+		customCommands[i] = MBuild.CustomCommand:new(settings);
+	end
+	return customCommands;
+end
+
+-- Fills project from its cache entry when every input is unchanged, otherwise remembers the fingerprint for Save
+function ProjectCache.Restore(workspace, project, workspaceFingerprint)
+	project.cacheFingerprint = nil;
+	project.restored         = false;
+	if not workspaceFingerprint then
+		return false;
+	end
+	local callback = ProjectCache.Signature(project.callback);
+	if not callback then
+		return false;
+	end
+	project.cacheFingerprint = fs.hash(workspaceFingerprint .. "\n" .. project.name .. "\n" .. callback);
+
+	local entry = MBuild.Deserialize(ProjectCache.EntryPath(workspace, project));
+	if not IsCurrent(entry, project.cacheFingerprint) then
+		return false;
+	end
+
+	local state               = entry.state;
+	project.location          = state.location;
+	project.evaluatedLocation = state.evaluatedLocation;
+	project.configMap         = RestoreConfigMap(state.configMap);
+	project.customCommands    = RestoreCustomCommands(state.customCommands);
+	project.files             = {};
+	for i, saved in ipairs(state.files) do
+		local files          = MBuild.Files:new(saved.inclusions, saved.exclusions, nil);
+		files.configMap      = RestoreConfigMap(saved.configMap);
+		files.customCommands = RestoreCustomCommands(saved.customCommands);
+		project.files[i]     = files;
+	end
+	project.restored = true;
+	return true;
+end
+
+-- Writes the configured and evaluated project with everything recorded while configuring it
+function ProjectCache.Save(workspace, project)
+	local recorder = project.cacheRecord;
+	if not project.cacheFingerprint or not recorder or not recorder.cacheable then
+		return;
+	end
+
+	local entry = {
+		version     = ProjectCache.version,
+		fingerprint = project.cacheFingerprint,
+		scripts     = {},
+		queries     = {},
+		state       = {
+			location          = project.location,
+			evaluatedLocation = project.evaluatedLocation,
+			configMap         = SaveConfigMap(project.configMap),
+			customCommands    = SaveCustomCommands(project.customCommands),
+			files             = {}
+		}
+	};
+	for path, _ in pairs(recorder.scripts) do
+		local suc, hash = fs.hash_file(path);
+		if not suc then
+			return;
+		end
+		entry.scripts[path] = hash;
+	end
+	local keys = {};
+	for key, _ in pairs(recorder.queries) do
+		table.insert(keys, key);
+	end
+	table.sort(keys);
+	for _, key in ipairs(keys) do
+		local query  = recorder.queries[key];
+		query.result = QueryResult(query);
+		if not query.result then
+			return;
+		end
+		table.insert(entry.queries, query);
+	end
+	for i, files in ipairs(project.files) do
+		entry.state.files[i] = {
+			inclusions     = files.inclusions,
+			exclusions     = files.exclusions,
+			configMap      = SaveConfigMap(files.configMap),
+			customCommands = SaveCustomCommands(files.customCommands)
+		};
+	end
+
+	local suc, content = pcall(MBuild.Serialize, entry);
+	if suc then
+		MBuild.WriteFileIfChanged(ProjectCache.EntryPath(workspace, project), content);
+	end
+end
\ No newline at end of file
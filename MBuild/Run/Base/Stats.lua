@@ -0,0 +1,333 @@
+-- Build statistics for "mbuild build --stats[=output.json]".
+-- Actions come from the entries ninja appended to .ninja_log during the build, the build file provides the dependencies
+-- between them for the critical path and the project every action belongs to.
+MBuild.Stats = MBuild.Stats or {
+	top     = 10, -- Slowest actions and most rebuilt projects listed, --stats-top=N
+	buckets = 20  -- Samples of the utilization timeline
+};
+
+local Stats = MBuild.Stats;
+
+function Stats.LogPath(buildFile)
+	return fs.append(fs.parent_path(buildFile), ".ninja_log");
+end
+
+-- Returns the entries of a ninja log (v5 and later: start, end, mtime, output, command hash), times in milliseconds
+function Stats.ReadLog(path)
+	local entries = {};
+	local content = MBuild.ReadFile(path);
+	if not content then
+		return entries;
+	end
+	for line in content:gmatch("[^\r\n]+") do
+		local start, finish, mtime, output, hash = line:match("^(%d+)\t(%d+)\t(%-?%d+)\t([^\t]+)\t?(.*)$");
+		if start then
+			table.insert(entries, {
+				line   = line,
+				start  = tonumber(start),
+				finish = tonumber(finish),
+				mtime  = mtime,
+				output = output,
+				hash   = hash
+			});
+		end
+	end
+	return entries;
+end
+
+-- Remembers the log before the build, ninja may recompact the log so new entries are told apart by content, not offset
+function Stats.Snapshot(buildFile)
+	local snapshot = { lines = {}, mtimes = {} };
+	for _, entry in ipairs(Stats.ReadLog(Stats.LogPath(buildFile))) do
+		snapshot.lines[entry.line]    = true;
+		snapshot.mtimes[entry.output] = entry.mtime;
+	end
+	return snapshot;
+end
+
+-- Loads the graph of a build file written by MBuild.Ninja, edges know the project they belong to from its "# Project" comments
+function Stats.ReadGraph(buildFile)
+	local suc, buildGraph = graph.load(buildFile);
+	if not suc then
+		error(buildGraph, 0);
+	end
+	return buildGraph;
+end
+
+-- The busy time of the actions overlapping [first, last) in milliseconds
+local function BusyTime(actions, first, last)
+	local busy = 0;
+	for _, action in ipairs(actions) do
+		busy = busy + math.max(0, math.min(action.finish, last) - math.max(action.start, first));
+	end
+	return busy;
+end
+
+-- Orders projects by the actions they ran and keeps the top ones
+local function SortProjects(projects)
+	table.sort(projects, function(a, b)
+		if a.actions ~= b.actions then
+			return a.actions > b.actions;
+		end
+		return a.name < b.name;
+	end);
+	for i = #projects, Stats.top + 1, -1 do
+		projects[i] = nil;
+	end
+end
+
+-- Combines the log entries ninja appended since the snapshot with the graph of the build file.
+-- timings = { configure, graph, execution } in seconds, jobs is the parallelism ninja ran with
+function Stats.Collect(buildFile, snapshot, timings, jobs)
+	local buildGraph = Stats.ReadGraph(buildFile);
+
+	-- Every output of an edge gets its own log entry, they share the times and the command hash
+	local actions = {};
+	local byKey   = {};
+	for _, entry in ipairs(Stats.ReadLog(Stats.LogPath(buildFile))) do
+		if not snapshot.lines[entry.line] then
+			local key    = string.format("%d\t%d\t%s", entry.start, entry.finish, entry.hash);
+			local action = byKey[key];
+			if not action then
+				action     = { start = entry.start, finish = entry.finish, outputs = {}, unchanged = true };
+				byKey[key] = action;
+				table.insert(actions, action);
+			end
+			table.insert(action.outputs, entry.output);
+			local node  = buildGraph:node(entry.output);
+			action.edge = action.edge or (node and buildGraph:producer(node));
+
+			-- Restat leaves the mtime of an output the action didn't change, so dependents were skipped as with a cache hit
+			if entry.mtime == "0" or snapshot.mtimes[entry.output] ~= entry.mtime then
+				action.unchanged = false;
+			end
+		end
+	end
+
+	local total = 0;
+	for edge = 1, buildGraph:edge_count() do
+		if buildGraph:rule(edge) ~= "phony" then
+			total = total + 1;
+		end
+	end
+
+	local stats = {
+		time        = {
+			configure = timings.configure,
+			graph     = timings.graph,
+			execution = timings.execution,
+			total     = timings.configure + timings.graph + timings.execution
+		},
+		actions     = { run = #actions, cacheHits = 0, skipped = math.max(0, total - #actions), total = total },
+		work        = { total = 0, criticalPath = 0, criticalPathActions = {} },
+		utilization = { jobs = jobs, average = 0, span = 0, timeline = {} },
+		slowest     = {},
+		projects    = {}
+	};
+	if #actions == 0 then
+		buildGraph:close();
+		return stats;
+	end
+
+	local first, last = math.huge, 0;
+	local perProject  = {};
+	local byOutput    = {};
+	for _, action in ipairs(actions) do
+		action.duration = (action.finish - action.start) / 1000;
+		action.project  = action.edge and buildGraph:project(action.edge) or "(workspace)";
+		first           = math.min(first, action.start);
+		last            = math.max(last, action.finish);
+
+		stats.work.total = stats.work.total + action.duration;
+		if action.unchanged then
+			stats.actions.cacheHits = stats.actions.cacheHits + 1;
+		end
+		local project = perProject[action.project];
+		if not project then
+			project                    = { name = action.project, actions = 0, cacheHits = 0 };
+			perProject[action.project] = project;
+			table.insert(stats.projects, project);
+		end
+		project.actions = project.actions + 1;
+		if action.unchanged then
+			project.cacheHits = project.cacheHits + 1;
+		end
+		if action.edge then
+			for _, node in ipairs(buildGraph:outputs(action.edge)) do
+				byOutput[node] = action;
+			end
+		end
+	end
+
+	-- Longest chain of actions that ran, an action depends on the actions producing its inputs, phony edges are looked through
+	local function Dependencies(edge, result, visited)
+		for _, input in ipairs(buildGraph:inputs(edge)) do
+			if not visited[input] then
+				visited[input] = true;
+				local action   = byOutput[input];
+				local producer = buildGraph:producer(input);
+				if action then
+					table.insert(result, action);
+				elseif producer and buildGraph:rule(producer) == "phony" then
+					Dependencies(producer, result, visited);
+				end
+			end
+		end
+		return result;
+	end
+	local function Critical(action)
+		if action.critical then
+			return action.critical;
+		end
+		action.critical = action.duration;
+		if action.edge then
+			for _, dependency in ipairs(Dependencies(action.edge, {}, {})) do
+				if dependency ~= action and Critical(dependency) + action.duration > action.critical then
+					action.critical = dependency.critical + action.duration;
+					action.previous = dependency;
+				end
+			end
+		end
+		return action.critical;
+	end
+	local tail;
+	for _, action in ipairs(actions) do
+		if Critical(action) > (tail and tail.critical or -1) then
+			tail = action;
+		end
+	end
+	stats.work.criticalPath = tail.critical;
+	while tail do
+		table.insert(stats.work.criticalPathActions, 1, tail.outputs[1]);
+		tail = tail.previous;
+	end
+
+	local span = last - first;
+	if span > 0 then
+		stats.utilization.span    = span / 1000;
+		stats.utilization.average = BusyTime(actions, first, last) / (span * jobs);
+		for i = 1, Stats.buckets do
+			local from = first + span * (i - 1) / Stats.buckets;
+			local to   = first + span * i / Stats.buckets;
+			stats.utilization.timeline[i] = BusyTime(actions, from, to) / ((to - from) * jobs);
+		end
+	end
+
+	table.sort(actions, function(a, b) return a.duration > b.duration; end);
+	for i = 1, math.min(Stats.top, #actions) do
+		table.insert(stats.slowest, { output = actions[i].outputs[1], project = actions[i].project, duration = actions[i].duration });
+	end
+	SortProjects(stats.projects);
+	buildGraph:close();
+	return stats;
+end
+
+-- Utilization of build files that ran one after another, their timelines are laid end to end and sampled again
+local function MergeUtilization(list)
+	local segments = {};
+	local span     = 0;
+	local busy     = 0;
+	for _, stats in ipairs(list) do
+		local utilization = stats.utilization;
+		local width       = utilization.span / math.max(1, #utilization.timeline);
+		for i, sample in ipairs(utilization.timeline) do
+			table.insert(segments, { from = span + width * (i - 1), to = span + width * i, value = sample });
+		end
+		busy = busy + utilization.average * utilization.span;
+		span = span + utilization.span;
+	end
+
+	local merged = { jobs = list[1].utilization.jobs, average = 0, span = span, timeline = {} };
+	if span > 0 then
+		merged.average = busy / span;
+		for i = 1, Stats.buckets do
+			local from  = span * (i - 1) / Stats.buckets;
+			local to    = span * i / Stats.buckets;
+			local value = 0;
+			for _, segment in ipairs(segments) do
+				value = value + math.max(0, math.min(segment.to, to) - math.max(segment.from, from)) * segment.value;
+			end
+			merged.timeline[i] = value / (to - from);
+		end
+	end
+	return merged;
+end
+
+-- Merges the stats of several build files, as built by one "mbuild build"
+function Stats.Merge(list)
+	local merged      = list[1];
+	local projects    = {};
+	local utilization = MergeUtilization(list);
+	for _, project in ipairs(merged.projects) do
+		projects[project.name] = project;
+	end
+	for i = 2, #list do
+		local stats = list[i];
+		for _, key in ipairs({ "run", "cacheHits", "skipped", "total" }) do
+			merged.actions[key] = merged.actions[key] + stats.actions[key];
+		end
+		merged.work.total         = merged.work.total + stats.work.total;
+		merged.work.criticalPath  = merged.work.criticalPath + stats.work.criticalPath;
+		merged.time.execution     = merged.time.execution + stats.time.execution;
+		merged.time.total         = merged.time.total + stats.time.execution;
+		for _, action in ipairs(stats.work.criticalPathActions) do
+			table.insert(merged.work.criticalPathActions, action);
+		end
+		for _, action in ipairs(stats.slowest) do
+			table.insert(merged.slowest, action);
+		end
+		for _, project in ipairs(stats.projects) do
+			local existing = projects[project.name];
+			if existing then
+				existing.actions   = existing.actions + project.actions;
+				existing.cacheHits = existing.cacheHits + project.cacheHits;
+			else
+				projects[project.name] = project;
+				table.insert(merged.projects, project);
+			end
+		end
+	end
+	merged.utilization = utilization;
+	table.sort(merged.slowest, function(a, b) return a.duration > b.duration; end);
+	for i = #merged.slowest, Stats.top + 1, -1 do
+		merged.slowest[i] = nil;
+	end
+	SortProjects(merged.projects);
+	return merged;
+end
+
+function Stats.Print(stats)
+	print("Build statistics:");
+	printf("  Time:        configure %.3fs, graph %.3fs, execution %.3fs", stats.time.configure, stats.time.graph, stats.time.execution);
+	printf("  Actions:     %d run (%d cache hits), %d up to date", stats.actions.run, stats.actions.cacheHits, stats.actions.skipped);
+	printf("  Work:        %.3fs total, %.3fs critical path", stats.work.total, stats.work.criticalPath);
+	printf("  Utilization: %.1f%% of %d jobs", stats.utilization.average * 100, stats.utilization.jobs);
+	if #stats.slowest > 0 then
+		print("  Slowest actions:");
+		for _, action in ipairs(stats.slowest) do
+			printf("    %8.3fs  %s  %s", action.duration, action.project, action.output);
+		end
+	end
+	if #stats.projects > 0 then
+		print("  Most rebuilt projects:");
+		for _, project in ipairs(stats.projects) do
+			printf("    %8d  %s (%d cache hits)", project.actions, project.name, project.cacheHits);
+		end
+	end
+end
+
+function Stats.Write(stats, path)
+	local json, err = MBuild.JSON.Encode(stats, "\t");
+	if not json then
+		printf("Failed to encode build statistics: %s", err);
+		return false;
+	end
+	MBuild.WriteFileIfChanged(path, json .. "\n");
+	printf("Build statistics written to '%s'", path);
+	return true;
+end
+
+local top = tonumber(MBuild.options["stats-top"] or "");
+if top and top >= 0 then
+	Stats.top = math.floor(top);
+end
\ No newline at end of file
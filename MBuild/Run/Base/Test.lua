@@ -0,0 +1,330 @@
+-- Test runner for "mbuild test", every Kind("Test") project is a test binary.
+-- The shards of all binaries are run by ninja from a generated Tests.ninja, which runs them in parallel and prints the
+-- captured output of every shard in one piece. TestFramework("GTest") binaries are split into shards by test name,
+-- balanced on the durations recorded by earlier runs.
+MBuild.Test = MBuild.Test or {
+	defaultDuration = 1 -- Seconds assumed for tests without a recorded duration
+};
+
+local Test = MBuild.Test;
+
+function Test.HistoryPath()
+	return fs.append(MBuild.CacheDir(), "TestDurations.lua");
+end
+
+-- { [binary] = { duration, tests = { [name] = duration } } }, durations in seconds
+function Test.LoadHistory()
+	return MBuild.Deserialize(Test.HistoryPath()) or {};
+end
+
+local function InDirectory(directory, command)
+	if os.host() == "windows" then
+		return string.format("cd /d %s && %s", MBuild.ShellQuote(directory), command);
+	end
+	return string.format("cd %s && %s", MBuild.ShellQuote(directory), command);
+end
+
+-- Returns the full names of the tests in a GTest binary, nil when listing them failed
+function Test.ListGTests(binary, directory)
+	local pipe = io.popen(InDirectory(directory, MBuild.ShellQuote(binary) .. " --gtest_list_tests"), "r");
+	if not pipe then
+		return nil;
+	end
+	local output = pipe:read("*a");
+	pipe:close();
+
+	-- "Suite." lines are followed by their indented "  Test" lines, parameterized ones carry a "  # GetParam() = ..." comment
+	local tests = {};
+	local suite;
+	for line in output:gmatch("[^\r\n]+") do
+		local name = line:gsub("%s+#.*$", "");
+		if name:find("^%s") then
+			if suite then
+				table.insert(tests, suite .. name:match("^%s*(.-)%s*$"));
+			end
+		elseif name:sub(-1) == "." then
+			suite = name;
+		else
+			suite = nil;
+		end
+	end
+	if #tests == 0 then
+		return nil;
+	end
+	return tests;
+end
+
+-- Splits tests into at most count shards, every test, longest first, goes to the shard with the least work so far
+function Test.Balance(tests, durations, count)
+	local known, sum = 0, 0;
+	for _, name in ipairs(tests) do
+		if durations[name] then
+			known = known + 1;
+			sum   = sum + durations[name];
+		end
+	end
+	local default = known > 0 and sum / known or Test.defaultDuration;
+
+	local sorted = MBuild.ShallowCopy(tests);
+	table.sort(sorted, function(a, b)
+		local da, db = durations[a] or default, durations[b] or default;
+		if da ~= db then
+			return da > db;
+		end
+		return a < b;
+	end);
+
+	local shards = {};
+	for i = 1, math.max(1, math.min(count, #tests)) do
+		shards[i] = { tests = {}, duration = 0 };
+	end
+	for _, name in ipairs(sorted) do
+		local target = shards[1];
+		for _, shard in ipairs(shards) do
+			if shard.duration < target.duration then
+				target = shard;
+			end
+		end
+		table.insert(target.tests, name);
+		target.duration = target.duration + (durations[name] or default);
+	end
+	for _, shard in ipairs(shards) do
+		table.sort(shard.tests);
+	end
+	return shards;
+end
+
+-- Writes the manifests of the shards of a test project, returns { name, manifest, result, binary, duration }
+function Test.PlanProject(project, configs, binary, history, jobs, directory)
+	local testDir  = fs.append(fs.append(configs.objDir, project.name), "Tests");
+	local recorded = history[binary] or { tests = {} };
+	local count    = configs.testShards or (configs.testFramework == "GTest" and jobs or 1);
+
+	local shards = { { duration = recorded.duration or Test.defaultDuration } };
+	local gtest  = configs.testFramework == "GTest";
+	if gtest then
+		local tests = Test.ListGTests(binary, directory);
+		if tests then
+			shards = Test.Balance(tests, recorded.tests or {}, count);
+		else
+			gtest = false;
+		end
+	end
+
+	local planned = {};
+	for i, shard in ipairs(shards) do
+		local base     = fs.append(testDir, string.format("Shard%d", i));
+		local manifest = {
+			name      = #shards > 1 and string.format("%s [%d/%d]", project.name, i, #shards) or project.name,
+			binary    = binary,
+			directory = directory,
+			log       = base .. ".log",
+			result    = base .. ".result.lua",
+			gtest     = gtest
+		};
+		if gtest then
+			-- Filters are passed through a flag file, a long filter would overflow the command line on Windows
+			manifest.report   = base .. ".json";
+			manifest.flagfile = base .. ".flags";
+			MBuild.WriteFileIfChanged(manifest.flagfile, string.format("--gtest_filter=%s\n--gtest_output=json:%s\n", table.concat(shard.tests, ":"), manifest.report));
+		end
+		local manifestPath = base .. ".lua";
+		MBuild.WriteFileIfChanged(manifestPath, MBuild.Serialize(manifest));
+		table.insert(planned, {
+			name     = manifest.name,
+			manifest = manifestPath,
+			result   = manifest.result,
+			binary   = binary,
+			duration = shard.duration
+		});
+	end
+	return planned;
+end
+
+-- Writes Tests.ninja with an edge per shard, the longest shards first so they start as early as possible
+function Test.Generate(path, shards)
+	table.sort(shards, function(a, b)
+		if a.duration ~= b.duration then
+			return a.duration > b.duration;
+		end
+		return a.name < b.name;
+	end);
+
+	local Ninja  = MBuild.Ninja;
+	local writer = Ninja.Writer:new();
+	writer:Comment("This file is generated by MBuild, do not edit!");
+	writer:Variable("ninja_required_version", "1.10");
+	writer:Variable("builddir", Ninja.EscapeValue(fs.append(fs.parent_path(path), "Tests")));
+	writer:Variable("mbuild", Ninja.EscapeValue(Ninja.MBuildCommand()));
+	writer:Line();
+	writer:Rule("test", {
+		command     = "$mbuild test-shard $manifest",
+		description = "TEST $name"
+	});
+	local results = {};
+	for i, shard in ipairs(shards) do
+		results[i] = shard.result;
+		writer:Build({
+			outputs  = { shard.result },
+			rule     = "test",
+			implicit = { shard.binary, shard.manifest },
+			vars     = {
+				manifest = Ninja.EscapeValue(Ninja.Quote(shard.manifest)),
+				name     = Ninja.EscapeValue(shard.name)
+			}
+		});
+	end
+	writer:Default(results);
+	writer:Save(path);
+	return path;
+end
+
+-- Returns { [test] = { duration, failed } } from a GTest JSON report
+local function ReadReport(path)
+	local tests   = {};
+	local content = MBuild.ReadFile(path);
+	local report  = content and MBuild.JSON.Decode(content);
+	if type(report) ~= "table" or type(report.testsuites) ~= "table" then
+		return tests;
+	end
+	for _, suite in ipairs(report.testsuites) do
+		for _, test in ipairs(suite.testsuite or {}) do
+			tests[suite.name .. "." .. test.name] = {
+				duration = tonumber(tostring(test.time or ""):match("^[%d%.]+")) or 0,
+				failed   = type(test.failures) == "table" and #test.failures > 0
+			};
+		end
+	end
+	return tests;
+end
+
+-- Runs one shard with its output captured into the log, which is printed in one piece afterwards
+function Test.RunShard(manifestPath)
+	local manifest = MBuild.Deserialize(manifestPath);
+	if not manifest then
+		printf("Failed to load test manifest '%s'", manifestPath);
+		return 1;
+	end
+
+	local command = MBuild.ShellQuote(manifest.binary);
+	if manifest.flagfile then
+		os.remove(manifest.report);
+		command = command .. " --gtest_flagfile=" .. MBuild.ShellQuote(manifest.flagfile);
+	end
+	fs.create_directories(fs.parent_path(manifest.log));
+	local start  = os.monotonic();
+	local code   = MBuild.Execute(InDirectory(manifest.directory, command) .. " > " .. MBuild.ShellQuote(manifest.log) .. " 2>&1");
+	local result = { exitCode = code, duration = os.monotonic() - start, tests = {} };
+
+	local output = MBuild.ReadFile(manifest.log) or "";
+	if #output > 0 then
+		io.write(output);
+		io.flush();
+	end
+	if manifest.report then
+		result.tests = ReadReport(manifest.report);
+	end
+	MBuild.WriteFileIfChanged(manifest.result, MBuild.Serialize(result));
+	return code;
+end
+
+-- test [projects...] builds and runs the Kind("Test") projects of the selected configuration, all of them by default
+MBuild.RegisterCommand("test", function(self, args)
+	self:InvokeMainScript(fs.absolute("MBuild.lua"));
+	self:Configure();
+	self:Generate();
+
+	local selected = {};
+	for _, name in ipairs(args) do
+		selected[name] = true;
+	end
+
+	local jobs    = self.Ninja.Jobs();
+	local history = Test.LoadHistory();
+	local summary = { shards = 0, failedShards = {}, tests = 0, failedTests = {} };
+	for _, workspace in ipairs(self.workspaces) do
+		local name, platform = self:SelectConfiguration(workspace);
+		local buildFile      = self.Ninja.BuildFile(workspace, name, platform);
+		local toolchain      = self.Toolchains.ForConfig(workspace.configMap[name][platform]);
+
+		local projects = {};
+		for _, project in ipairs(workspace.projects) do
+			local configs = project.configMap[name][platform].configs;
+			if configs.kind == "Test" and (#args == 0 or selected[project.name]) then
+				table.insert(projects, project);
+			end
+		end
+
+		if #projects > 0 then
+			local targets = {};
+			for i, project in ipairs(projects) do
+				targets[i] = project.name;
+			end
+			local result = self.Ninja.Run(buildFile, jobs, targets);
+			if result ~= 0 then
+				return result;
+			end
+
+			local shards = {};
+			for _, project in ipairs(projects) do
+				local configs   = project.configMap[name][platform].configs;
+				local binary    = self.Ninja.ProjectOutput(toolchain, project, configs);
+				local directory = configs.runDir or fs.current_path();
+				for _, shard in ipairs(Test.PlanProject(project, configs, binary, history, jobs, directory)) do
+					os.remove(shard.result);
+					table.insert(shards, shard);
+				end
+			end
+
+			-- Failing shards mustn't stop the others, the results tell which ones failed
+			local testsFile = Test.Generate(fs.append(fs.parent_path(buildFile), "Tests.ninja"), shards);
+			self.Ninja.Run(testsFile, jobs, nil, { "-k", "0" });
+
+			for _, shard in ipairs(shards) do
+				local result = MBuild.Deserialize(shard.result) or { exitCode = -1, duration = 0, tests = {} };
+				local record = history[shard.binary] or { tests = {} };
+				history[shard.binary] = record;
+
+				summary.shards = summary.shards + 1;
+				if result.exitCode ~= 0 then
+					table.insert(summary.failedShards, shard.name);
+				end
+				if next(result.tests) then
+					for test, info in pairs(result.tests) do
+						record.tests[test] = info.duration;
+						summary.tests      = summary.tests + 1;
+						if info.failed then
+							table.insert(summary.failedTests, test);
+						end
+					end
+				else
+					record.duration = result.duration;
+				end
+			end
+		end
+	end
+	MBuild.WriteFileIfChanged(Test.HistoryPath(), MBuild.Serialize(history));
+
+	table.sort(summary.failedShards);
+	table.sort(summary.failedTests);
+	printf("Tests: %d shards, %d failed", summary.shards, #summary.failedShards);
+	for _, shard in ipairs(summary.failedShards) do
+		printf("  FAILED %s", shard);
+	end
+	if summary.tests > 0 then
+		printf("GTest cases: %d run, %d failed", summary.tests, #summary.failedTests);
+		for _, test in ipairs(summary.failedTests) do
+			printf("  FAILED %s", test);
+		end
+	end
+	return #summary.failedShards > 0 and 1 or 0;
+end);
+
+-- test-shard <manifest>
+MBuild.RegisterCommand("test-shard", function(self, args)
+	if #args ~= 1 then
+		print("Usage: mbuild test-shard <manifest>");
+		return 1;
+	end
+	return Test.RunShard(args[1]);
+end);
\ No newline at end of file
@@ -0,0 +1,326 @@
+MBuild.Toolchains = MBuild.Toolchains or {
+	toolchains = {}
+};
+
+local Toolchains = MBuild.Toolchains;
+
+-- Commands write their output to $out.tmp, which only replaces $out when the content differs.
+-- Together with restat this keeps an identical rebuilt object from relinking everything depending on it.
+local function ReplaceIfChanged(command)
+	return command .. " && { cmp -s $out.tmp $out && rm -f $out.tmp || mv -f $out.tmp $out; }";
+end
+
+local function ReplaceIfChangedCmd(command)
+	return "cmd /c " .. command .. " && (fc /b $out.tmp $out >nul 2>&1 && del $out.tmp || move /y $out.tmp $out >nul)";
+end
+
+local function GNULike(name, prefix, cc, cxx, pchExt)
+	return {
+		name   = name,
+		prefix = prefix,
+		tools  = {
+			cc   = cc,
+			cxx  = cxx,
+			ar   = "ar",
+			link = cxx
+		},
+		extensions = {
+			[".c"]    = "cc",
+			[".cc"]   = "cxx",
+			[".cpp"]  = "cxx",
+			[".cxx"]  = "cxx",
+			[".cppm"] = "cxx",
+			[".ixx"]  = "cxx",
+			[".mpp"]  = "cxx"
+		},
+		-- Module interface extensions the compiler driver doesn't take as C++ on its own
+		languageFlags = {
+			[".cppm"] = "-x c++",
+			[".ixx"]  = "-x c++",
+			[".mpp"]  = "-x c++"
+		},
+		objExt    = ".o",
+		exeExt    = "",
+		libPrefix = "lib",
+		libExt    = ".a",
+		pchExt    = pchExt,
+
+		-- A single verbose preprocess reports the version, target and system include dirs
+		probe = {
+			args         = "-E -x c++ -v -",
+			version      = "version (%d[%d%.]*)",
+			target       = "Target: (%S+)",
+			includeStart = "#include <...> search starts here:",
+			includeEnd   = "End of search list."
+		},
+
+		includeDir = "-I%s",
+		pchUse     = "-Winvalid-pch -include %s",
+		splitDwarf = "-g -gsplit-dwarf",
+		gdbIndex   = "-Wl,--gdb-index",
+		warnings   = {
+			Off   = "-w",
+			On    = "-Wall",
+			Extra = "-Wall -Wextra"
+		},
+
+		-- Picked by Linker(), "Auto" uses the first of linkerPreference found in PATH
+		linkers = {
+			BFD  = { flags = "-fuse-ld=bfd", executables = { "ld.bfd" } },
+			Gold = { flags = "-fuse-ld=gold", executables = { "ld.gold" }, gdbIndex = true },
+			LLD  = { flags = "-fuse-ld=lld", executables = { "ld.lld" }, gdbIndex = true },
+			Mold = { flags = "-fuse-ld=mold", executables = { "ld.mold", "mold" }, gdbIndex = true }
+		},
+		linkerPreference = { "Mold", "LLD", "Gold" },
+
+		rules = {
+			cc = {
+				command     = ReplaceIfChanged("$cc -MD -MT $out -MF $out.d $flags -c $in -o $out.tmp"),
+				depfile     = "$out.d",
+				deps        = "gcc",
+				restat      = "1",
+				description = "CC $out"
+			},
+			cxx = {
+				command     = ReplaceIfChanged("$cxx -MD -MT $out -MF $out.d $flags -c $in -o $out.tmp"),
+				depfile     = "$out.d",
+				deps        = "gcc",
+				restat      = "1",
+				description = "CXX $out"
+			},
+			pch = {
+				command     = "$cxx -MD -MF $out.d $flags -x c++-header -c $in -o $out",
+				depfile     = "$out.d",
+				deps        = "gcc",
+				description = "PCH $out"
+			},
+			-- Thin archives only reference the objects instead of copying them. An object with new code but the same size
+			-- and symbols gives a byte identical archive, so it is always replaced and dependents relink
+			archive = {
+				command         = "rm -f $out && $ar crsT $out @$out.rsp",
+				rspfile         = "$out.rsp",
+				rspfile_content = "$in",
+				description     = "AR $out"
+			},
+			link = {
+				command         = ReplaceIfChanged("$link $ldflags -o $out.tmp @$out.rsp"),
+				rspfile         = "$out.rsp",
+				rspfile_content = "$in",
+				restat          = "1",
+				description     = "LINK $out",
+				pool            = "link_pool"
+			}
+		}
+	};
+end
+
+function Toolchains.Register(toolchain)
+	Toolchains.toolchains[toolchain.name] = toolchain;
+end
+
+function Toolchains.Get(name)
+	local toolchain = Toolchains.toolchains[name];
+	if not toolchain then
+		error(string.format("Unknown compiler '%s'", tostring(name)));
+	end
+	return toolchain;
+end
+
+-- Mirrors the defaults of the CompilerMap in MBuild.lua
+function Toolchains.Default(system)
+	if system == "windows" then
+		return Toolchains.Get("MSVC/CL");
+	elseif system == "macosx" then
+		return Toolchains.Get("LLVM/clang");
+	else
+		return Toolchains.Get("GNU/gcc");
+	end
+end
+
+-- Returns the linker entry of the toolchain Linker() asked for, nil means the compiler driver's default linker
+function Toolchains.ResolveLinker(toolchain, name)
+	if not name or name == "Default" then
+		return nil;
+	end
+
+	if name == "Auto" then
+		if toolchain.autoLinker == nil then
+			toolchain.autoLinker = false;
+			for _, candidate in ipairs(toolchain.linkerPreference or {}) do
+				for _, executable in ipairs(toolchain.linkers[candidate].executables) do
+					if MBuild.Probe.FindExecutable(executable) then
+						toolchain.autoLinker = toolchain.linkers[candidate];
+						break;
+					end
+				end
+				if toolchain.autoLinker then
+					break;
+				end
+			end
+		end
+		return toolchain.autoLinker or nil;
+	end
+
+	local linker = toolchain.linkers and toolchain.linkers[name];
+	if not linker then
+		error(string.format("Linker '%s' is not supported by '%s'", name, toolchain.name));
+	end
+	return linker;
+end
+
+function Toolchains.ForConfig(config)
+	return Toolchains.Get(config.configs.compiler or Toolchains.Default(config.system).name);
+end
+
+local function MapperLine(name, bmi)
+	return name .. " " .. bmi;
+end
+
+-- GCC 14+ writes the scan results while preprocessing and finds BMIs through a module mapper file
+local gcc   = GNULike("GNU/gcc", "gcc", "gcc", "g++", ".gch");
+gcc.modules = {
+	flags     = "-std=c++20 -fmodules-ts",
+	bmiExt    = ".gcm",
+	modmap    = "-fmodule-mapper=%s",
+	provide   = MapperLine,
+	reference = MapperLine
+};
+gcc.rules.scan = {
+	command     = "$mbuild scan-deps $out $in -- $cxx $flags -E -x c++ $in -MT $out -MD -MF $out.d -fdeps-format=p1689r5 -fdeps-file=$out.tmp -fdeps-target=$obj -o $out.i",
+	depfile     = "$out.d",
+	deps        = "gcc",
+	restat      = "1",
+	description = "SCAN $out"
+};
+Toolchains.Register(gcc);
+
+-- Clang 17+ scans through clang-scan-deps, the modmap is a response file with the module flags
+local clang       = GNULike("LLVM/clang", "clang", "clang", "clang++", ".pch");
+clang.tools.scan  = "clang-scan-deps";
+clang.modules     = {
+	flags     = "-std=c++20",
+	bmiExt    = ".pcm",
+	modmap    = "@%s",
+	provide   = function(name, bmi)
+		return "-x c++-module -fmodule-output=" .. bmi;
+	end,
+	reference = function(name, bmi)
+		return string.format("-fmodule-file=%s=%s", name, bmi);
+	end
+};
+clang.rules.scan = {
+	command     = "$mbuild scan-deps $out $in -- $scan -format=p1689 -o $out.tmp -- $cxx $flags -x c++ -c $in -o $obj -MT $out -MD -MF $out.d",
+	depfile     = "$out.d",
+	deps        = "gcc",
+	restat      = "1",
+	description = "SCAN $out"
+};
+Toolchains.Register(clang);
+
+Toolchains.Register({
+	name   = "MSVC/CL",
+	prefix = "msvc",
+	tools  = {
+		cc   = "cl",
+		cxx  = "cl",
+		ar   = "lib",
+		link = "link"
+	},
+	extensions = {
+		[".c"]    = "cc",
+		[".cc"]   = "cxx",
+		[".cpp"]  = "cxx",
+		[".cxx"]  = "cxx",
+		[".cppm"] = "cxx",
+		[".ixx"]  = "cxx",
+		[".mpp"]  = "cxx"
+	},
+	-- CL knows .ixx as an interface unit, the modmap adds /interface to the others
+	languageFlags = {
+		[".cppm"] = "/TP",
+		[".mpp"]  = "/TP"
+	},
+	objExt    = ".obj",
+	exeExt    = ".exe",
+	libPrefix = "",
+	libExt    = ".lib",
+	pchExt    = ".pch",
+
+	-- CL prints its banner when invoked without arguments, system include dirs come from %INCLUDE%
+	probe = {
+		args    = "",
+		version = "Version (%d[%d%.]*)",
+		target  = "Version [%d%.]+ for (%w+)"
+	},
+
+	-- CL creates the precompiled header while compiling PCHSource
+	pchFromSource = true,
+
+	modules = {
+		flags     = "/std:c++20",
+		bmiExt    = ".ifc",
+		modmap    = "@%s",
+		provide   = function(name, bmi, interface)
+			return string.format("%s /ifcOutput %s", interface and "/interface" or "/internalPartition", bmi);
+		end,
+		reference = function(name, bmi)
+			return string.format("/reference %s=%s", name, bmi);
+		end
+	},
+
+	includeDir = "/I%s",
+	pchUse     = "/Yu%s /FI%s /Fp%s",
+	warnings   = {
+		Off   = "/W0",
+		On    = "/W3",
+		Extra = "/W4"
+	},
+
+	-- lld-link replaces link for the link edges of projects using it
+	linkers = {
+		LLD = { tool = "lld-link", executables = { "lld-link" } }
+	},
+	linkerPreference = { "LLD" },
+
+	rules = {
+		cc = {
+			command     = ReplaceIfChangedCmd("$cc /nologo /Brepro /showIncludes $flags /c $in /Fo$out.tmp"),
+			deps        = "msvc",
+			restat      = "1",
+			description = "CC $out"
+		},
+		cxx = {
+			command     = ReplaceIfChangedCmd("$cxx /nologo /Brepro /showIncludes /EHsc $flags /c $in /Fo$out.tmp"),
+			deps        = "msvc",
+			restat      = "1",
+			description = "CXX $out"
+		},
+		-- /showIncludes has to be parsed by ninja, so MSVC scans aren't routed through the scan cache
+		scan = {
+			command     = ReplaceIfChangedCmd("$cxx /nologo /TP /showIncludes $flags /scanDependencies $out.tmp /Fo$obj $in"),
+			deps        = "msvc",
+			restat      = "1",
+			description = "SCAN $out"
+		},
+		pch = {
+			command     = "$cxx /nologo /showIncludes /EHsc $flags /Yc$pchheader /Fp$pch /c $in /Fo$out",
+			deps        = "msvc",
+			description = "PCH $pch"
+		},
+		archive = {
+			command         = ReplaceIfChangedCmd("$ar /nologo /Brepro /OUT:$out.tmp @$out.rsp"),
+			rspfile         = "$out.rsp",
+			rspfile_content = "$in",
+			restat          = "1",
+			description     = "LIB $out"
+		},
+		link = {
+			command         = ReplaceIfChangedCmd("$link /nologo /Brepro $ldflags /OUT:$out.tmp @$out.rsp"),
+			rspfile         = "$out.rsp",
+			rspfile_content = "$in",
+			restat          = "1",
+			description     = "LINK $out",
+			pool            = "link_pool"
+		}
+	}
+});
\ No newline at end of file
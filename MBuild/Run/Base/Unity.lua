@@ -0,0 +1,85 @@
+MBuild.Unity = MBuild.Unity or {
+	defaultBatchSize = 8,
+	extensions       = {
+		cc  = ".c",
+		cxx = ".cpp"
+	}
+};
+
+local Unity = MBuild.Unity;
+
+function Unity.Hash(str)
+	local hash = 5381;
+	for i = 1, #str do
+		hash = bit.tobit(hash * 33 + str:byte(i));
+	end
+	return hash;
+end
+
+-- Batch boundaries are picked from the hash of each path instead of its index,
+-- so adding or removing a file only changes the membership of its own batch
+function Unity.Split(paths, batchSize)
+	batchSize     = math.max(1, math.floor(batchSize));
+	local batches = {};
+	local batch   = {};
+	for _, path in ipairs(paths) do
+		table.insert(batch, path);
+		if Unity.Hash(path) % batchSize == 0 or #batch >= batchSize * 2 then
+			table.insert(batches, batch);
+			batch = {};
+		end
+	end
+	if #batch > 0 then
+		table.insert(batches, batch);
+	end
+	return batches;
+end
+
+function Unity.Content(batch)
+	local lines = { "// This file is generated by MBuild, do not edit!" };
+	for _, path in ipairs(batch) do
+		table.insert(lines, string.format("#include \"%s\"", path));
+	end
+	return table.concat(lines, "\n") .. "\n";
+end
+
+-- sources = array of { path, tool, configs, flags }, returns the sources with every unity enabled source replaced by its batch
+function Unity.Batch(sources, unityDir)
+	local result = {};
+	local groups = {};
+	local keys   = {};
+	for _, source in ipairs(sources) do
+		-- Module units can't share a translation unit, every one of them declares its own module.
+		-- Generated sources stay separate so their compile edges depend on the command producing them
+		if source.configs.unityBuild and not source.generated and not (source.tool == "cxx" and source.configs.modules) then
+			local key   = source.tool .. "\0" .. source.flags;
+			local group = groups[key];
+			if not group then
+				group       = { tool = source.tool, configs = source.configs, flags = source.flags, pch = source.pch, paths = {}, batchSize = source.configs.unityBatchSize or Unity.defaultBatchSize };
+				groups[key] = group;
+				table.insert(keys, key);
+			end
+			table.insert(group.paths, source.path);
+		else
+			table.insert(result, source);
+		end
+	end
+
+	for _, key in ipairs(keys) do
+		local group = groups[key];
+		table.sort(group.paths);
+		for _, batch in ipairs(Unity.Split(group.paths, group.batchSize)) do
+			local path = fs.append(unityDir, string.format("Unity_%08x_%08x%s", Unity.Hash(key) % 0x100000000, Unity.Hash(batch[1]) % 0x100000000, Unity.extensions[group.tool]));
+			MBuild.WriteFileIfChanged(path, Unity.Content(batch));
+			table.insert(result, {
+				path    = path,
+				tool    = group.tool,
+				configs = group.configs,
+				flags   = group.flags,
+				pch     = group.pch,
+				members = batch
+			});
+		end
+	end
+	return result;
+end
\ No newline at end of file
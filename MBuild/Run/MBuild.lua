@@ -18,6 +18,8 @@ Workspace("MBuild", function()
 	BinDir("${workspace.location}/Bin/${config.system}-${config.arch}-${config.name}/");
 	RunDir("${project.location}/Run/");
 
+	When("configuration == 'Dist'", function() Package("TarZstd"); end);
+
 	Project("MBuild", function()
 		Location("${workspace.location}/MBuild/"); -- Default is './'
 		Warnings("Extra");
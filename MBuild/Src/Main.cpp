@@ -2,11 +2,13 @@
 
 #include <Build.h>
 
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 
 #include <filesystem>
 #include <stdexcept>
+#include <string>
 
 static int WrapExceptions(lua_State* L, lua_CFunction f)
 {
@@ -24,7 +26,8 @@ static int WrapExceptions(lua_State* L, lua_CFunction f)
 	}
 	catch (...)
 	{
-		lua_pushliteral(L, "caught (...)");
+		// Lua errors unwind as foreign exceptions too, they have to pass through with their message
+		throw;
 	}
 	return lua_error(L);
 }
@@ -88,19 +91,52 @@ static int osArch(lua_State* L)
 {
 #if BUILD_IS_PLATFORM_AMD64
 	lua_pushstring(L, "x86-64");
+#elif BUILD_IS_PLATFORM_X86
+	lua_pushstring(L, "x86");
+#elif BUILD_IS_PLATFORM_ARM64
+	lua_pushstring(L, "arm64");
+#elif BUILD_IS_PLATFORM_ARM32
+	lua_pushstring(L, "arm32");
 #else
 	lua_pushstring(L, "unknown");
 #endif
 	return 1;
 }
 
+// Seconds since an unspecified point, only meant for measuring durations. os.clock() is CPU time and os.time() has second resolution
+static int osMonotonic(lua_State* L)
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	lua_pushnumber(L, std::chrono::duration<lua_Number>(now).count());
+	return 1;
+}
+
+static std::string s_Executable;
+
+static int osExecutable(lua_State* L)
+{
+	lua_pushstring(L, s_Executable.c_str());
+	return 1;
+}
+
 extern void AddFilesystemLib(lua_State* state);
+extern void AddFSFFILib(lua_State* state);
+extern void AddTableLib(lua_State* state);
+extern void AddCPULib(lua_State* state);
+extern void AddGraphLib(lua_State* state);
 
 int main(int argc, char** argv)
 {
-	lua_State* L = luaL_newstate();
+	{
+		std::error_code ec;
+#if BUILD_IS_SYSTEM_LINUX
+		s_Executable = std::filesystem::read_symlink("/proc/self/exe", ec).string();
+		if (ec)
+#endif
+			s_Executable = std::filesystem::absolute(argv[0], ec).lexically_normal().string();
+	}
 
-	luaJIT_setmode(L, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON);
+	lua_State* L = luaL_newstate();
 
 	lua_pushlightuserdata(L, &WrapExceptions);
 	luaJIT_setmode(L, -1, LUAJIT_MODE_WRAPCFUNC | LUAJIT_MODE_ON);
@@ -108,13 +144,24 @@ int main(int argc, char** argv)
 
 	luaL_openlibs(L);
 
+	// Has to come after luaL_openlibs(), opening the jit library resets the JIT flags and parameters to their defaults
+	luaJIT_setmode(L, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON);
+
 	AddFilesystemLib(L);
+	AddFSFFILib(L);
+	AddTableLib(L);
+	AddCPULib(L);
+	AddGraphLib(L);
 
 	lua_getglobal(L, "os");
 	lua_pushcfunction(L, &osHost);
 	lua_setfield(L, -2, "host");
 	lua_pushcfunction(L, &osArch);
 	lua_setfield(L, -2, "arch");
+	lua_pushcfunction(L, &osExecutable);
+	lua_setfield(L, -2, "executable");
+	lua_pushcfunction(L, &osMonotonic);
+	lua_setfield(L, -2, "monotonic");
 	lua_pop(L, 1);
 
 	lua_getglobal(L, "debug");
@@ -124,6 +171,15 @@ int main(int argc, char** argv)
 	lua_setfield(L, -2, "dump_stack");
 	lua_pop(L, 1);
 
+	// Same layout as the standalone interpreter, arg[0] is the executable
+	lua_createtable(L, argc > 1 ? argc - 1 : 0, 1);
+	for (int i = 0; i < argc; ++i)
+	{
+		lua_pushstring(L, argv[i]);
+		lua_rawseti(L, -2, i);
+	}
+	lua_setglobal(L, "arg");
+
 	auto initFile = std::filesystem::absolute("Base/Init.lua").lexically_normal();
 	if (luaL_loadfile(L, initFile.string().c_str()))
 	{
@@ -137,26 +193,18 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	// Runs the command named by the first argument, without one the main script is configured and generated
 	lua_getglobal(L, "MBuild");
-	lua_getfield(L, -1, "InvokeMainScript");
-	lua_pushvalue(L, -2);
-	lua_pushstring(L, "MBuild.lua");
-	if (lua_pcall(L, 2, 0, 0))
-	{
-		std::fprintf(stderr, "%s\n", lua_tostring(L, -1));
-		return 1;
-	}
-
-	lua_getfield(L, -1, "Configure");
+	lua_getfield(L, -1, "Main");
 	lua_pushvalue(L, -2);
-	if (lua_pcall(L, 1, 0, 0))
+	if (lua_pcall(L, 1, 1, 0))
 	{
 		std::fprintf(stderr, "%s\n", lua_tostring(L, -1));
 		return 1;
 	}
-
-	lua_pop(L, 1);
+	int result = static_cast<int>(lua_tointeger(L, -1));
+	lua_pop(L, 2);
 
 	lua_close(L);
-	return 0;
+	return result;
 }
\ No newline at end of file
@@ -0,0 +1,449 @@
+#include <lua.hpp>
+
+#include <Build.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <fstream>
+#include <initializer_list>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define CPU_IS_X86 1
+	#if BUILD_IS_TOOLSET_MSVC
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#else
+	#define CPU_IS_X86 0
+#endif
+
+#if BUILD_IS_SYSTEM_WINDOWS
+	#include <Windows.h>
+#elif BUILD_IS_SYSTEM_MACOSX
+	#include <sys/sysctl.h>
+	#include <sys/types.h>
+#elif BUILD_IS_SYSTEM_LINUX
+	#include <sched.h>
+#endif
+
+struct CPUInfo
+{
+	std::string           arch;
+	std::string           vendor;
+	std::string           model;
+	std::string           level; // x86-64 micro architecture level, e.g. "x86-64-v3"
+	std::uint32_t         cores   = 0;
+	std::uint32_t         threads = 0;
+	std::uint64_t         l1d     = 0;
+	std::uint64_t         l1i     = 0;
+	std::uint64_t         l2      = 0;
+	std::uint64_t         l3      = 0;
+	std::set<std::string> features;
+};
+
+static std::string Trim(std::string str)
+{
+	std::size_t start = str.find_first_not_of(" \t");
+	std::size_t end   = str.find_last_not_of(" \t\r\n");
+	if (start == std::string::npos)
+		return {};
+	return str.substr(start, end - start + 1);
+}
+
+#if CPU_IS_X86
+static void CPUID(std::uint32_t leaf, std::uint32_t subleaf, std::uint32_t (&regs)[4])
+{
+	#if BUILD_IS_TOOLSET_MSVC
+	int r[4];
+	__cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+	for (int i = 0; i < 4; ++i)
+		regs[i] = static_cast<std::uint32_t>(r[i]);
+	#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+	#endif
+}
+
+static std::uint64_t XGetBV()
+{
+	#if BUILD_IS_TOOLSET_MSVC
+	return _xgetbv(0);
+	#else
+	std::uint32_t eax, edx;
+	__asm__ volatile("xgetbv"
+					 : "=a"(eax), "=d"(edx)
+					 : "c"(0));
+	return (static_cast<std::uint64_t>(edx) << 32) | eax;
+	#endif
+}
+
+static void DetectX86(CPUInfo& info)
+{
+	std::uint32_t regs[4];
+	CPUID(0, 0, regs);
+	std::uint32_t maxLeaf = regs[0];
+	char          vendor[13] {};
+	std::memcpy(vendor, &regs[1], 4);
+	std::memcpy(vendor + 4, &regs[3], 4);
+	std::memcpy(vendor + 8, &regs[2], 4);
+	info.vendor = vendor;
+
+	CPUID(0x8000'0000, 0, regs);
+	std::uint32_t maxExtLeaf = regs[0];
+	if (maxExtLeaf >= 0x8000'0004)
+	{
+		char brand[49] {};
+		for (std::uint32_t i = 0; i < 3; ++i)
+		{
+			CPUID(0x8000'0002 + i, 0, regs);
+			std::memcpy(brand + i * 16, regs, 16);
+		}
+		info.model = Trim(brand);
+	}
+
+	auto add = [&info](bool present, const char* name) {
+		if (present)
+			info.features.emplace(name);
+	};
+
+	bool osAVX    = false;
+	bool osAVX512 = false;
+	if (maxLeaf >= 1)
+	{
+		CPUID(1, 0, regs);
+		std::uint32_t ecx = regs[2];
+		std::uint32_t edx = regs[3];
+		add(edx & (1U << 25), "sse");
+		add(edx & (1U << 26), "sse2");
+		add(ecx & (1U << 0), "sse3");
+		add(ecx & (1U << 9), "ssse3");
+		add(ecx & (1U << 12), "fma");
+		add(ecx & (1U << 13), "cx16");
+		add(ecx & (1U << 19), "sse4_1");
+		add(ecx & (1U << 20), "sse4_2");
+		add(ecx & (1U << 22), "movbe");
+		add(ecx & (1U << 23), "popcnt");
+		add(ecx & (1U << 25), "aes");
+		add(ecx & (1U << 29), "f16c");
+
+		// AVX state has to be enabled by the OS as well, otherwise the instructions fault
+		if ((ecx & (1U << 27)) && (ecx & (1U << 28)))
+		{
+			std::uint64_t xcr0 = XGetBV();
+			osAVX              = (xcr0 & 0x6) == 0x6;
+			osAVX512           = (xcr0 & 0xE6) == 0xE6;
+		}
+		add(osAVX, "avx");
+		if (!osAVX)
+		{
+			info.features.erase("fma");
+			info.features.erase("f16c");
+		}
+	}
+
+	if (maxLeaf >= 7)
+	{
+		CPUID(7, 0, regs);
+		std::uint32_t ebx = regs[1];
+		add(ebx & (1U << 3), "bmi1");
+		add(osAVX && (ebx & (1U << 5)), "avx2");
+		add(ebx & (1U << 8), "bmi2");
+		add(osAVX512 && (ebx & (1U << 16)), "avx512f");
+		add(osAVX512 && (ebx & (1U << 17)), "avx512dq");
+		add(osAVX512 && (ebx & (1U << 28)), "avx512cd");
+		add(osAVX512 && (ebx & (1U << 30)), "avx512bw");
+		add(osAVX512 && (ebx & (1U << 31)), "avx512vl");
+		add(ebx & (1U << 29), "sha");
+	}
+
+	if (maxExtLeaf >= 0x8000'0001)
+	{
+		CPUID(0x8000'0001, 0, regs);
+		add(regs[2] & (1U << 5), "lzcnt");
+	}
+
+	auto has = [&info](std::initializer_list<const char*> names) {
+		for (const char* name : names)
+			if (!info.features.contains(name))
+				return false;
+		return true;
+	};
+	#if defined(__x86_64__) || defined(_M_X64)
+	info.level = "x86-64";
+	if (has({ "cx16", "popcnt", "sse3", "sse4_1", "sse4_2", "ssse3" }))
+	{
+		info.level = "x86-64-v2";
+		if (has({ "avx", "avx2", "bmi1", "bmi2", "f16c", "fma", "lzcnt", "movbe" }))
+		{
+			info.level = "x86-64-v3";
+			if (has({ "avx512f", "avx512bw", "avx512cd", "avx512dq", "avx512vl" }))
+				info.level = "x86-64-v4";
+		}
+	}
+	#endif
+}
+#endif
+
+#if BUILD_IS_SYSTEM_LINUX
+static std::uint64_t ParseCacheSize(const std::string& str)
+{
+	std::uint64_t size = 0;
+	std::size_t   i    = 0;
+	while (i < str.size() && str[i] >= '0' && str[i] <= '9')
+		size = size * 10 + static_cast<std::uint64_t>(str[i++] - '0');
+	if (i < str.size())
+	{
+		switch (str[i])
+		{
+		case 'K': size <<= 10; break;
+		case 'M': size <<= 20; break;
+		case 'G': size <<= 30; break;
+		}
+	}
+	return size;
+}
+
+static std::string ReadLine(const std::string& path)
+{
+	std::ifstream file(path);
+	std::string   line;
+	std::getline(file, line);
+	return Trim(line);
+}
+
+static void DetectLinux(CPUInfo& info)
+{
+	std::ifstream file("/proc/cpuinfo");
+	std::string   line;
+
+	std::set<std::pair<std::string, std::string>> physicalCores;
+	std::string                                   physicalId;
+	std::string                                   coreId;
+	while (std::getline(file, line))
+	{
+		std::size_t colon = line.find(':');
+		if (colon == std::string::npos)
+		{
+			// Processors are separated by empty lines
+			if (!coreId.empty())
+				physicalCores.emplace(physicalId, coreId);
+			physicalId.clear();
+			coreId.clear();
+			continue;
+		}
+
+		std::string key   = Trim(line.substr(0, colon));
+		std::string value = Trim(line.substr(colon + 1));
+		if (key == "physical id")
+		{
+			physicalId = value;
+		}
+		else if (key == "core id")
+		{
+			coreId = value;
+		}
+		else if (info.model.empty() && (key == "model name" || key == "Model"))
+		{
+			info.model = value;
+		}
+		else if (info.vendor.empty() && (key == "vendor_id" || key == "CPU implementer"))
+		{
+			info.vendor = value;
+		}
+		else if (key == "Features")
+		{
+			// ARM reports its extensions here, "asimd" is the AArch64 name of NEON
+			std::size_t start = 0;
+			while (start < value.size())
+			{
+				std::size_t end = value.find(' ', start);
+				if (end == std::string::npos)
+					end = value.size();
+				std::string feature = value.substr(start, end - start);
+				if (feature == "asimd" || feature == "neon")
+					info.features.emplace("neon");
+				else if (!feature.empty())
+					info.features.emplace(std::move(feature));
+				start = end + 1;
+			}
+		}
+	}
+	if (!coreId.empty())
+		physicalCores.emplace(physicalId, coreId);
+	if (!physicalCores.empty())
+		info.cores = static_cast<std::uint32_t>(physicalCores.size());
+
+	// CI runners and containers often restrict the process to fewer CPUs than the machine has
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+		info.threads = static_cast<std::uint32_t>(CPU_COUNT(&set));
+
+	for (int index = 0;; ++index)
+	{
+		std::string dir   = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+		std::string level = ReadLine(dir + "level");
+		if (level.empty())
+			break;
+		std::string   type = ReadLine(dir + "type");
+		std::uint64_t size = ParseCacheSize(ReadLine(dir + "size"));
+		if (level == "1" && type == "Data")
+			info.l1d = size;
+		else if (level == "1" && type == "Instruction")
+			info.l1i = size;
+		else if (level == "2")
+			info.l2 = size;
+		else if (level == "3")
+			info.l3 = size;
+	}
+}
+#elif BUILD_IS_SYSTEM_WINDOWS
+static void DetectWindows(CPUInfo& info)
+{
+	DWORD length = 0;
+	GetLogicalProcessorInformation(nullptr, &length);
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> entries(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (entries.empty() || !GetLogicalProcessorInformation(entries.data(), &length))
+		return;
+
+	std::uint32_t cores = 0;
+	for (auto& entry : entries)
+	{
+		if (entry.Relationship == RelationProcessorCore)
+		{
+			++cores;
+		}
+		else if (entry.Relationship == RelationCache)
+		{
+			auto& cache = entry.Cache;
+			if (cache.Level == 1 && cache.Type == CacheData)
+				info.l1d = cache.Size;
+			else if (cache.Level == 1 && cache.Type == CacheInstruction)
+				info.l1i = cache.Size;
+			else if (cache.Level == 2)
+				info.l2 = cache.Size;
+			else if (cache.Level == 3)
+				info.l3 = cache.Size;
+		}
+	}
+	info.cores = cores;
+}
+#elif BUILD_IS_SYSTEM_MACOSX
+template <class T>
+static T SysctlValue(const char* name)
+{
+	T           value {};
+	std::size_t size = sizeof(value);
+	if (sysctlbyname(name, &value, &size, nullptr, 0) != 0)
+		return T {};
+	return value;
+}
+
+static void DetectMacOSX(CPUInfo& info)
+{
+	info.cores = static_cast<std::uint32_t>(SysctlValue<std::int32_t>("hw.physicalcpu"));
+	info.l1d   = static_cast<std::uint64_t>(SysctlValue<std::int64_t>("hw.l1dcachesize"));
+	info.l1i   = static_cast<std::uint64_t>(SysctlValue<std::int64_t>("hw.l1icachesize"));
+	info.l2    = static_cast<std::uint64_t>(SysctlValue<std::int64_t>("hw.l2cachesize"));
+	info.l3    = static_cast<std::uint64_t>(SysctlValue<std::int64_t>("hw.l3cachesize"));
+
+	char        brand[256] {};
+	std::size_t size = sizeof(brand) - 1;
+	if (info.model.empty() && sysctlbyname("machdep.cpu.brand_string", brand, &size, nullptr, 0) == 0)
+		info.model = brand;
+	if (SysctlValue<std::int32_t>("hw.optional.neon"))
+		info.features.emplace("neon");
+}
+#endif
+
+static const CPUInfo& GetCPUInfo()
+{
+	static CPUInfo s_Info = []() {
+		CPUInfo info;
+#if BUILD_IS_PLATFORM_AMD64 || defined(__x86_64__) || defined(_M_X64)
+		info.arch = "x86-64";
+#elif defined(__i386__) || defined(_M_IX86)
+		info.arch = "x86";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+		info.arch = "arm64";
+		info.features.emplace("neon"); // Mandatory in AArch64
+#elif defined(__arm__) || defined(_M_ARM)
+		info.arch = "arm32";
+#else
+		info.arch = "unknown";
+#endif
+		info.threads = std::thread::hardware_concurrency();
+
+#if CPU_IS_X86
+		DetectX86(info);
+#endif
+#if BUILD_IS_SYSTEM_LINUX
+		DetectLinux(info);
+#elif BUILD_IS_SYSTEM_WINDOWS
+		DetectWindows(info);
+#elif BUILD_IS_SYSTEM_MACOSX
+		DetectMacOSX(info);
+#endif
+
+		if (info.cores == 0)
+			info.cores = info.threads;
+		return info;
+	}();
+	return s_Info;
+}
+
+static int osCPU(lua_State* L)
+{
+	const CPUInfo& info = GetCPUInfo();
+
+	lua_createtable(L, 0, 8);
+	lua_pushstring(L, info.arch.c_str());
+	lua_setfield(L, -2, "arch");
+	lua_pushstring(L, info.vendor.c_str());
+	lua_setfield(L, -2, "vendor");
+	lua_pushstring(L, info.model.c_str());
+	lua_setfield(L, -2, "model");
+	if (!info.level.empty())
+	{
+		lua_pushstring(L, info.level.c_str());
+		lua_setfield(L, -2, "level");
+	}
+	lua_pushinteger(L, static_cast<lua_Integer>(info.cores));
+	lua_setfield(L, -2, "cores");
+	lua_pushinteger(L, static_cast<lua_Integer>(info.threads));
+	lua_setfield(L, -2, "threads");
+
+	lua_createtable(L, 0, 4);
+	lua_pushnumber(L, static_cast<lua_Number>(info.l1d));
+	lua_setfield(L, -2, "l1d");
+	lua_pushnumber(L, static_cast<lua_Number>(info.l1i));
+	lua_setfield(L, -2, "l1i");
+	lua_pushnumber(L, static_cast<lua_Number>(info.l2));
+	lua_setfield(L, -2, "l2");
+	lua_pushnumber(L, static_cast<lua_Number>(info.l3));
+	lua_setfield(L, -2, "l3");
+	lua_setfield(L, -2, "caches");
+
+	lua_createtable(L, 0, static_cast<int>(info.features.size()));
+	for (auto& feature : info.features)
+	{
+		lua_pushboolean(L, true);
+		lua_setfield(L, -2, feature.c_str());
+	}
+	lua_setfield(L, -2, "features");
+	return 1;
+}
+
+void AddCPULib(lua_State* L)
+{
+	lua_getglobal(L, "os");
+	lua_pushcfunction(L, &osCPU);
+	lua_setfield(L, -2, "cpu");
+	lua_pop(L, 1);
+}
\ No newline at end of file
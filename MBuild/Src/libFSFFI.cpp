@@ -0,0 +1,364 @@
+#include <lua.hpp>
+
+#include <Build.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <filesystem>
+#include <string>
+
+#if BUILD_IS_SYSTEM_WINDOWS
+	#include <Windows.h>
+#else
+	#include <sys/stat.h>
+#endif
+
+// C ABI for the hot fs primitives, Base/FFI.lua calls these through LuaJIT FFI function pointers so loops over files can be compiled into traces.
+// Every function reports errors through its return value, exceptions must never cross this boundary.
+extern "C"
+{
+	// Keep in sync with the cdef in Base/FFI.lua
+	enum MBuildFSType : std::int32_t
+	{
+		MBuildFSType_None = 0,
+		MBuildFSType_NotFound,
+		MBuildFSType_Regular,
+		MBuildFSType_Directory,
+		MBuildFSType_Symlink,
+		MBuildFSType_Block,
+		MBuildFSType_Character,
+		MBuildFSType_Fifo,
+		MBuildFSType_Socket,
+		MBuildFSType_Unknown
+	};
+
+	struct MBuildFSStat
+	{
+		std::int64_t  lastWriteTime; // Microseconds, same clock as fs.last_write_time
+		std::uint64_t size;          // Only set for regular files
+		std::int32_t  type;
+	};
+
+	// Microseconds on the clock of fs.last_write_time from a system time in nanoseconds since the Unix epoch
+	static std::int64_t ToLastWriteTime(std::int64_t seconds, std::int64_t nanoseconds)
+	{
+		std::chrono::sys_time<std::chrono::nanoseconds> time { std::chrono::seconds(seconds) + std::chrono::nanoseconds(nanoseconds) };
+		return std::chrono::time_point_cast<std::chrono::duration<std::int64_t, std::micro>, std::chrono::utc_clock>(std::filesystem::file_time_type::clock::to_utc(std::filesystem::file_time_type::clock::from_sys(time))).time_since_epoch().count();
+	}
+
+	// One stat() instead of separate status, size and time queries. Returns 0 on success, otherwise the system error code
+	static int MBuildFSStatPath(const char* path, MBuildFSStat* out)
+	{
+		out->type          = MBuildFSType_NotFound;
+		out->size          = 0;
+		out->lastWriteTime = 0;
+#if BUILD_IS_SYSTEM_WINDOWS
+		WIN32_FILE_ATTRIBUTE_DATA data {};
+		if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+		{
+			DWORD error = GetLastError();
+			if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND)
+				return 0;
+			out->type = MBuildFSType_None;
+			return static_cast<int>(error);
+		}
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			out->type = MBuildFSType_Directory;
+		}
+		else
+		{
+			out->type = MBuildFSType_Regular;
+			out->size = static_cast<std::uint64_t>(data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+		}
+		// FILETIME counts 100ns intervals since 1601
+		std::int64_t time  = static_cast<std::int64_t>(static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime) - 116'444'736'000'000'000;
+		out->lastWriteTime = ToLastWriteTime(time / 10'000'000, time % 10'000'000 * 100);
+		return 0;
+#else
+		struct stat st {};
+		if (::stat(path, &st) != 0)
+		{
+			if (errno == ENOENT || errno == ENOTDIR)
+				return 0;
+			out->type = MBuildFSType_None;
+			return errno;
+		}
+		if (S_ISREG(st.st_mode))
+		{
+			out->type = MBuildFSType_Regular;
+			out->size = static_cast<std::uint64_t>(st.st_size);
+		}
+		else if (S_ISDIR(st.st_mode))
+		{
+			out->type = MBuildFSType_Directory;
+		}
+		else if (S_ISBLK(st.st_mode))
+		{
+			out->type = MBuildFSType_Block;
+		}
+		else if (S_ISCHR(st.st_mode))
+		{
+			out->type = MBuildFSType_Character;
+		}
+		else if (S_ISFIFO(st.st_mode))
+		{
+			out->type = MBuildFSType_Fifo;
+		}
+		else if (S_ISSOCK(st.st_mode))
+		{
+			out->type = MBuildFSType_Socket;
+		}
+		else
+		{
+			out->type = MBuildFSType_Unknown;
+		}
+	#if BUILD_IS_SYSTEM_MACOSX
+		out->lastWriteTime = ToLastWriteTime(st.st_mtimespec.tv_sec, st.st_mtimespec.tv_nsec);
+	#else
+		out->lastWriteTime = ToLastWriteTime(st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+	#endif
+		return 0;
+#endif
+	}
+
+	// Returns 1 if the path exists, 0 if it does not and -1 on error
+	static int MBuildFSExists(const char* path)
+	{
+		std::error_code ec;
+		bool            exists = std::filesystem::exists(path, ec);
+		if (ec)
+			return -1;
+		return exists ? 1 : 0;
+	}
+
+	// Returns 0 on success, otherwise the system error code
+	static int MBuildFSLastWriteTime(const char* path, std::int64_t* out)
+	{
+		std::error_code ec;
+		*out = std::chrono::time_point_cast<std::chrono::duration<std::int64_t, std::micro>, std::chrono::utc_clock>(std::filesystem::file_time_type::clock::to_utc(std::filesystem::last_write_time(path, ec))).time_since_epoch().count();
+		return ec.value();
+	}
+
+	// The last write time in nanoseconds since the Unix epoch as the file system stores it, without the clock conversions
+	// and the truncation to microseconds of last_write_time. Returns 0 on success, otherwise the system error code
+	static int MBuildFSMTimeNS(const char* path, std::int64_t* out)
+	{
+#if BUILD_IS_SYSTEM_WINDOWS
+		WIN32_FILE_ATTRIBUTE_DATA data {};
+		if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+			return static_cast<int>(GetLastError());
+		// FILETIME counts 100ns intervals since 1601
+		*out = (static_cast<std::int64_t>(static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime) - 116'444'736'000'000'000) * 100;
+		return 0;
+#else
+		struct stat st {};
+		if (::stat(path, &st) != 0)
+			return errno;
+	#if BUILD_IS_SYSTEM_MACOSX
+		*out = static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1'000'000'000 + st.st_mtimespec.tv_nsec;
+	#else
+		*out = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+	#endif
+		return 0;
+#endif
+	}
+
+	// Writes at most size bytes including the null terminator, returns the length of the normalized path or -1 on error.
+	// If the result is not less than size the output was truncated and the call has to be repeated with a bigger buffer.
+	static std::ptrdiff_t MBuildFSNormalize(const char* path, char* out, std::size_t size)
+	{
+		try
+		{
+			std::string normal = std::filesystem::path(path).lexically_normal().string();
+			if (normal.size() < size)
+				std::memcpy(out, normal.c_str(), normal.size() + 1);
+			return static_cast<std::ptrdiff_t>(normal.size());
+		}
+		catch (...)
+		{
+			return -1;
+		}
+	}
+
+	// 64 bit FNV-1a
+	static std::uint64_t MBuildFSHash(const char* data, std::size_t size)
+	{
+		std::uint64_t hash = 0xCBF2'9CE4'8422'2325ULL;
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 0x0000'0100'0000'01B3ULL;
+		}
+		return hash;
+	}
+
+	// Hashes the content of a file with MBuildFSHash, returns 0 on success, otherwise -1
+	static int MBuildFSHashFile(const char* path, std::uint64_t* out)
+	{
+		std::FILE* file = std::fopen(path, "rb");
+		if (!file)
+			return -1;
+
+		std::uint64_t hash = 0xCBF2'9CE4'8422'2325ULL;
+		char          buffer[16384];
+		std::size_t   read;
+		while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+		{
+			for (std::size_t i = 0; i < read; ++i)
+			{
+				hash ^= static_cast<unsigned char>(buffer[i]);
+				hash *= 0x0000'0100'0000'01B3ULL;
+			}
+		}
+		bool failed = std::ferror(file) != 0;
+		std::fclose(file);
+		if (failed)
+			return -1;
+		*out = hash;
+		return 0;
+	}
+}
+
+static constexpr const char* c_FSTypeNames[] = {
+	"none",
+	"not_found",
+	"regular",
+	"directory",
+	"symlink",
+	"block",
+	"character",
+	"fifo",
+	"socket",
+	"unknown"
+};
+
+static void PushHash(lua_State* L, std::uint64_t hash)
+{
+	char str[17];
+	std::snprintf(str, sizeof(str), "%016llx", static_cast<unsigned long long>(hash));
+	lua_pushlstring(L, str, 16);
+}
+
+static int FSStat(lua_State* L)
+{
+	if (!lua_isstring(L, 1))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Path has to be a valid string");
+		return 2;
+	}
+
+	MBuildFSStat stat {};
+	if (int error = MBuildFSStatPath(lua_tostring(L, 1), &stat))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, std::system_category().message(error).c_str());
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+	lua_createtable(L, 0, 3);
+	lua_pushstring(L, c_FSTypeNames[stat.type]);
+	lua_setfield(L, -2, "type");
+	lua_pushnumber(L, static_cast<lua_Number>(stat.size));
+	lua_setfield(L, -2, "size");
+	lua_pushnumber(L, static_cast<lua_Number>(stat.lastWriteTime));
+	lua_setfield(L, -2, "last_write_time");
+	return 2;
+}
+
+static int FSHash(lua_State* L)
+{
+	std::size_t size = 0;
+	const char* data = lua_tolstring(L, 1, &size);
+	if (!data)
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Data has to be a valid string");
+		return 2;
+	}
+
+	PushHash(L, MBuildFSHash(data, size));
+	return 1;
+}
+
+static int FSHashFile(lua_State* L)
+{
+	if (!lua_isstring(L, 1))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Path has to be a valid string");
+		return 2;
+	}
+
+	std::uint64_t hash = 0;
+	if (MBuildFSHashFile(lua_tostring(L, 1), &hash))
+	{
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "Failed to read '%s'", lua_tostring(L, 1));
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	PushHash(L, hash);
+	return 2;
+}
+
+// Without FFI the time is a Lua number, which keeps current times to about a quarter of a microsecond
+static int FSMTimeNS(lua_State* L)
+{
+	if (!lua_isstring(L, 1))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Path has to be a valid string");
+		return 2;
+	}
+
+	std::int64_t time = 0;
+	if (int error = MBuildFSMTimeNS(lua_tostring(L, 1), &time))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, std::system_category().message(error).c_str());
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	lua_pushnumber(L, static_cast<lua_Number>(time));
+	return 2;
+}
+
+template <class F>
+static void PushFunctionPointer(lua_State* L, const char* name, F* function)
+{
+	lua_pushlightuserdata(L, reinterpret_cast<void*>(function));
+	lua_setfield(L, -2, name);
+}
+
+void AddFSFFILib(lua_State* L)
+{
+	lua_getglobal(L, "fs");
+	lua_pushcfunction(L, &FSStat);
+	lua_setfield(L, -2, "stat");
+	lua_pushcfunction(L, &FSHash);
+	lua_setfield(L, -2, "hash");
+	lua_pushcfunction(L, &FSHashFile);
+	lua_setfield(L, -2, "hash_file");
+	lua_pushcfunction(L, &FSMTimeNS);
+	lua_setfield(L, -2, "mtime_ns");
+
+	// Function pointers instead of exported symbols, so ffi.C does not need the executable to export anything
+	lua_createtable(L, 0, 7);
+	PushFunctionPointer(L, "stat", &MBuildFSStatPath);
+	PushFunctionPointer(L, "exists", &MBuildFSExists);
+	PushFunctionPointer(L, "last_write_time", &MBuildFSLastWriteTime);
+	PushFunctionPointer(L, "mtime_ns", &MBuildFSMTimeNS);
+	PushFunctionPointer(L, "normalize", &MBuildFSNormalize);
+	PushFunctionPointer(L, "hash", &MBuildFSHash);
+	PushFunctionPointer(L, "hash_file", &MBuildFSHashFile);
+	lua_setfield(L, -2, "ffi");
+	lua_pop(L, 1);
+}
\ No newline at end of file
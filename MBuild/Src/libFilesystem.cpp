@@ -1,7 +1,31 @@
 #include <lua.hpp>
 
+#include <Build.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if BUILD_IS_SYSTEM_WINDOWS
+	#include <Windows.h>
+#else
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
 
 static std::filesystem::directory_options ParseDirectoryOptions(const char* str)
 {
@@ -1061,7 +1085,7 @@ static int FSStatus(lua_State* L)
 	lua_pushstring(L, FileTypeToString(status.type()));
 	lua_setfield(L, -2, "type");
 	lua_pushstring(L, PermsToString(status.permissions()).c_str());
-	lua_setfield(L, -2, "type");
+	lua_setfield(L, -2, "permissions");
 	return 2;
 }
 
@@ -1088,7 +1112,7 @@ static int FSSymlinkStatus(lua_State* L)
 	lua_pushstring(L, FileTypeToString(status.type()));
 	lua_setfield(L, -2, "type");
 	lua_pushstring(L, PermsToString(status.permissions()).c_str());
-	lua_setfield(L, -2, "type");
+	lua_setfield(L, -2, "permissions");
 	return 2;
 }
 
@@ -1286,45 +1310,127 @@ static int FSIsSymlink(lua_State* L)
 	return 2;
 }
 
-static int FSInternalDirectoryIterator(lua_State* L) // Gets invoked by the for iteration logic, returned by FSDirectoryIterator
+static constexpr const char* c_DirectoryIteratorMetatable  = "fs.directory_iterator";
+static constexpr std::size_t c_MaxPooledDirectoryIterators = 16;
+static constexpr std::size_t c_MaxLiveDirectoryIterators   = 256;
+
+struct DirectoryIteratorState
 {
-	if (lua_isnil(L, 1))
-	{
-		lua_pushnil(L);
-		return 1;
-	}
+	bool                                          recursive = false;
+	std::filesystem::directory_iterator           iter;
+	std::filesystem::recursive_directory_iterator recursiveIter;
+	std::string                                   buffer;
+};
 
-	std::filesystem::directory_iterator* iter = (std::filesystem::directory_iterator*) lua_touserdata(L, 1);
-	if (*iter == std::filesystem::directory_iterator {})
-	{
-		lua_pushnil(L);
-		return 1;
-	}
+struct DirectoryIterator // Userdata, owns the state until closed, exhausted or collected
+{
+	DirectoryIteratorState* state;
+};
 
-	auto& path = (*iter)->path();
-	lua_pushstring(L, path.string().c_str());
-	++(*iter);
-	return 1;
+static std::vector<std::unique_ptr<DirectoryIteratorState>> s_DirectoryIteratorPool;
+static std::size_t                                          s_LiveDirectoryIterators = 0;
+
+static DirectoryIteratorState* AcquireDirectoryIteratorState()
+{
+	++s_LiveDirectoryIterators;
+	if (s_DirectoryIteratorPool.empty())
+		return new DirectoryIteratorState();
+
+	DirectoryIteratorState* state = s_DirectoryIteratorPool.back().release();
+	s_DirectoryIteratorPool.pop_back();
+	return state;
+}
+
+static void ReleaseDirectoryIteratorState(DirectoryIteratorState* state)
+{
+	// Resetting to the end iterators releases the directory handles straight away
+	state->iter          = {};
+	state->recursiveIter = {};
+	--s_LiveDirectoryIterators;
+	if (s_DirectoryIteratorPool.size() < c_MaxPooledDirectoryIterators)
+		s_DirectoryIteratorPool.emplace_back(state);
+	else
+		delete state;
+}
+
+static void CloseDirectoryIterator(DirectoryIterator* iterator)
+{
+	if (!iterator->state)
+		return;
+
+	ReleaseDirectoryIteratorState(iterator->state);
+	iterator->state = nullptr;
 }
 
-static int FSInternalRecursiveDirectoryIterator(lua_State* L) // Gets invoked by the for iteration logic, returned by FSRecursiveDirectoryIterator
+static DirectoryIteratorState* NewDirectoryIterator(lua_State* L)
 {
-	if (lua_isnil(L, 1))
+	// Loops that break without calling close() hold on to their handles until collected
+	if (s_LiveDirectoryIterators >= c_MaxLiveDirectoryIterators)
+		lua_gc(L, LUA_GCCOLLECT, 0);
+
+	DirectoryIterator* iterator = (DirectoryIterator*) lua_newuserdata(L, sizeof(DirectoryIterator));
+	iterator->state             = nullptr;
+	luaL_getmetatable(L, c_DirectoryIteratorMetatable);
+	lua_setmetatable(L, -2);
+	iterator->state = AcquireDirectoryIteratorState();
+	return iterator->state;
+}
+
+static void PushPath(lua_State* L, const std::filesystem::path& path, std::string& buffer)
+{
+#if BUILD_IS_SYSTEM_WINDOWS
+	buffer = path.string();
+	lua_pushlstring(L, buffer.data(), buffer.size());
+#else
+	(void) buffer;
+	const auto& native = path.native();
+	lua_pushlstring(L, native.data(), native.size());
+#endif
+}
+
+static int FSDirectoryIteratorClose(lua_State* L)
+{
+	DirectoryIterator* iterator = (DirectoryIterator*) luaL_checkudata(L, 1, c_DirectoryIteratorMetatable);
+	CloseDirectoryIterator(iterator);
+	return 0;
+}
+
+static int FSInternalDirectoryIterator(lua_State* L) // Gets invoked by the for iteration logic, returned by FSDirectoryIterator and FSRecursiveDirectoryIterator
+{
+	DirectoryIterator* iterator = (DirectoryIterator*) luaL_testudata(L, 1, c_DirectoryIteratorMetatable);
+	if (!iterator || !iterator->state)
 	{
 		lua_pushnil(L);
 		return 1;
 	}
 
-	std::filesystem::recursive_directory_iterator* iter = (std::filesystem::recursive_directory_iterator*) lua_touserdata(L, 1);
-	if (*iter == std::filesystem::recursive_directory_iterator {})
+	DirectoryIteratorState* state = iterator->state;
+	std::error_code         ec;
+	bool                    done;
+	if (state->recursive)
 	{
-		lua_pushnil(L);
-		return 1;
+		PushPath(L, state->recursiveIter->path(), state->buffer);
+		state->recursiveIter.increment(ec);
+		done = state->recursiveIter == std::filesystem::recursive_directory_iterator {};
+	}
+	else
+	{
+		PushPath(L, state->iter->path(), state->buffer);
+		state->iter.increment(ec);
+		done = state->iter == std::filesystem::directory_iterator {};
 	}
 
-	auto& path = (*iter)->path();
-	lua_pushstring(L, path.string().c_str());
-	++(*iter);
+	// A partial listing mustn't look complete, callers like the glob cache would keep it
+	if (ec)
+	{
+		CloseDirectoryIterator(iterator);
+		lua_pushstring(L, ec.message().c_str());
+		return luaL_error(L, "Failed to list the directory of '%s': %s", lua_tostring(L, -2), lua_tostring(L, -1));
+	}
+
+	// Close as soon as the last entry is handed out, so loops that run to completion never wait on the GC
+	if (done)
+		CloseDirectoryIterator(iterator);
 	return 1;
 }
 
@@ -1346,8 +1452,11 @@ static int FSDirectoryIterator(lua_State* L)
 	std::error_code       ec;
 
 	lua_pushcfunction(L, &FSInternalDirectoryIterator);
-	std::filesystem::directory_iterator* iter = (std::filesystem::directory_iterator*) lua_newuserdata(L, sizeof(*iter));
-	new (iter) std::filesystem::directory_iterator(path, opts, ec);
+	DirectoryIteratorState* state = NewDirectoryIterator(L);
+	state->recursive              = false;
+	state->iter                   = std::filesystem::directory_iterator(path, opts, ec);
+	if (ec || state->iter == std::filesystem::directory_iterator {})
+		CloseDirectoryIterator((DirectoryIterator*) lua_touserdata(L, -1));
 	lua_pushnil(L);
 	return 3;
 }
@@ -1356,7 +1465,7 @@ static int FSRecursiveDirectoryIterator(lua_State* L)
 {
 	if (!lua_isstring(L, 1))
 	{
-		lua_pushcfunction(L, &FSInternalRecursiveDirectoryIterator);
+		lua_pushcfunction(L, &FSInternalDirectoryIterator);
 		lua_pushnil(L);
 		lua_pushnil(L);
 		return 3;
@@ -1369,15 +1478,713 @@ static int FSRecursiveDirectoryIterator(lua_State* L)
 	std::filesystem::path path = lua_tostring(L, 1);
 	std::error_code       ec;
 
-	lua_pushcfunction(L, &FSInternalRecursiveDirectoryIterator);
-	std::filesystem::recursive_directory_iterator* iter = (std::filesystem::recursive_directory_iterator*) lua_newuserdata(L, sizeof(*iter));
-	new (iter) std::filesystem::recursive_directory_iterator(path, opts, ec);
+	lua_pushcfunction(L, &FSInternalDirectoryIterator);
+	DirectoryIteratorState* state = NewDirectoryIterator(L);
+	state->recursive              = true;
+	state->recursiveIter          = std::filesystem::recursive_directory_iterator(path, opts, ec);
+	if (ec || state->recursiveIter == std::filesystem::recursive_directory_iterator {})
+		CloseDirectoryIterator((DirectoryIterator*) lua_touserdata(L, -1));
 	lua_pushnil(L);
 	return 3;
 }
 
+// The last write time in microseconds since the Unix epoch and the file id (inode, or file index on Windows) of a directory from a single system call.
+// Unlike fs.last_write_time the time isn't UTC with leap seconds, it's only meant to be compared with other stamps and os.time()
+static bool DirectoryStamp(const char* path, std::int64_t& time, std::uint64_t& id)
+{
+#if BUILD_IS_SYSTEM_WINDOWS
+	HANDLE handle = CreateFileA(path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+	BY_HANDLE_FILE_INFORMATION info {};
+	bool                       result = GetFileInformationByHandle(handle, &info) && (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+	CloseHandle(handle);
+	if (!result)
+		return false;
+	// FILETIME counts 100ns intervals since 1601
+	time = static_cast<std::int64_t>((static_cast<std::uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32 | info.ftLastWriteTime.dwLowDateTime) / 10) - 11'644'473'600'000'000;
+	id   = static_cast<std::uint64_t>(info.nFileIndexHigh) << 32 | info.nFileIndexLow;
+	return true;
+#else
+	struct stat st {};
+	if (::stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+		return false;
+	#if BUILD_IS_SYSTEM_MACOSX
+	time = static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1'000'000 + st.st_mtimespec.tv_nsec / 1'000;
+	#else
+	time = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000 + st.st_mtim.tv_nsec / 1'000;
+	#endif
+	id = static_cast<std::uint64_t>(st.st_ino);
+	return true;
+#endif
+}
+
+static void PushDirectoryStamp(lua_State* L, std::int64_t time, std::uint64_t id)
+{
+	lua_pushnumber(L, static_cast<lua_Number>(time));
+	lua_pushnumber(L, static_cast<lua_Number>(id));
+}
+
+static int FSDirectoryStamp(lua_State* L)
+{
+	if (!lua_isstring(L, 1))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Path has to be a valid string");
+		return 2;
+	}
+
+	std::int64_t  time = 0;
+	std::uint64_t id   = 0;
+	if (!DirectoryStamp(lua_tostring(L, 1), time, id))
+	{
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "'%s' is not a directory", lua_tostring(L, 1));
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	PushDirectoryStamp(L, time, id);
+	return 3;
+}
+
+// Lists the regular files and the subdirectories of a directory by name, together with its stamp taken before listing.
+// Types come from the directory entries where the platform provides them, symlinks to directories aren't followed.
+static int FSScanDirectory(lua_State* L)
+{
+	if (!lua_isstring(L, 1))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Path has to be a valid string");
+		return 2;
+	}
+
+	const char*   path = lua_tostring(L, 1);
+	std::int64_t  time = 0;
+	std::uint64_t id   = 0;
+	if (!DirectoryStamp(path, time, id))
+	{
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "'%s' is not a directory", path);
+		return 2;
+	}
+
+	std::error_code                     ec;
+	std::filesystem::directory_iterator iter(path, std::filesystem::directory_options::skip_permission_denied, ec);
+	if (ec)
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, ec.message().c_str());
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+	PushDirectoryStamp(L, time, id);
+	lua_newtable(L);
+	lua_newtable(L);
+	int files       = lua_gettop(L) - 1;
+	int directories = lua_gettop(L);
+	int fileCount   = 0;
+	int dirCount    = 0;
+
+	std::string buffer;
+	for (; !ec && iter != std::filesystem::directory_iterator {}; iter.increment(ec))
+	{
+		const auto&     entry = *iter;
+		std::error_code entryEC;
+		if (entry.is_symlink(entryEC))
+		{
+			if (!entry.is_regular_file(entryEC))
+				continue;
+			PushPath(L, entry.path().filename(), buffer);
+			lua_rawseti(L, files, ++fileCount);
+		}
+		else if (entry.is_directory(entryEC))
+		{
+			PushPath(L, entry.path().filename(), buffer);
+			lua_rawseti(L, directories, ++dirCount);
+		}
+		else if (entry.is_regular_file(entryEC))
+		{
+			PushPath(L, entry.path().filename(), buffer);
+			lua_rawseti(L, files, ++fileCount);
+		}
+	}
+	if (ec)
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, ec.message().c_str());
+		return 2;
+	}
+	return 5;
+}
+
+static constexpr const char* c_FileBufferMetatable = "fs.file_buffer";
+
+struct FileMapping
+{
+	const char* data = nullptr; // Null for empty files, mapping zero bytes isn't possible
+	std::size_t size = 0;
+};
+
+static int LastSystemError()
+{
+#if BUILD_IS_SYSTEM_WINDOWS
+	return static_cast<int>(GetLastError());
+#else
+	return errno;
+#endif
+}
+
+// Maps the whole file read only, the handles are closed straight away as the view keeps the file alive on its own.
+// Returns 0 on success, otherwise the system error code
+static int MapFile(const char* path, FileMapping& mapping)
+{
+	mapping = {};
+#if BUILD_IS_SYSTEM_WINDOWS
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return LastSystemError();
+	LARGE_INTEGER size {};
+	if (!GetFileSizeEx(file, &size))
+	{
+		int error = LastSystemError();
+		CloseHandle(file);
+		return error;
+	}
+	if (size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return 0;
+	}
+
+	HANDLE view = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	int    error = view ? 0 : LastSystemError();
+	CloseHandle(file);
+	if (!view)
+		return error;
+	mapping.data = static_cast<const char*>(MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0));
+	error        = mapping.data ? 0 : LastSystemError();
+	CloseHandle(view);
+	if (!mapping.data)
+		return error;
+	mapping.size = static_cast<std::size_t>(size.QuadPart);
+	return 0;
+#else
+	int file = ::open(path, O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		return LastSystemError();
+	struct stat st {};
+	if (::fstat(file, &st) != 0)
+	{
+		int error = LastSystemError();
+		::close(file);
+		return error;
+	}
+	if (!S_ISREG(st.st_mode))
+	{
+		::close(file);
+		return EISDIR;
+	}
+	if (st.st_size == 0)
+	{
+		::close(file);
+		return 0;
+	}
+
+	void* data = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	int   error = data == MAP_FAILED ? LastSystemError() : 0;
+	::close(file);
+	if (data == MAP_FAILED)
+		return error;
+	mapping.data = static_cast<const char*>(data);
+	mapping.size = static_cast<std::size_t>(st.st_size);
+	return 0;
+#endif
+}
+
+static void UnmapFile(FileMapping& mapping)
+{
+	if (mapping.data)
+	{
+#if BUILD_IS_SYSTEM_WINDOWS
+		UnmapViewOfFile(mapping.data);
+#else
+		::munmap(const_cast<char*>(mapping.data), mapping.size);
+#endif
+	}
+	mapping = {};
+}
+
+struct FileBuffer // Userdata returned by fs.read
+{
+	FileMapping mapping;
+	std::size_t size;
+	int         stringRef; // Registry reference to the converted string, LUA_NOREF until string() is called
+	bool        closed;
+};
+
+static FileBuffer* CheckFileBuffer(lua_State* L)
+{
+	FileBuffer* buffer = (FileBuffer*) luaL_checkudata(L, 1, c_FileBufferMetatable);
+	if (buffer->closed)
+		luaL_error(L, "Attempt to use a closed file buffer");
+	return buffer;
+}
+
+static void CloseFileBuffer(lua_State* L, FileBuffer* buffer)
+{
+	UnmapFile(buffer->mapping);
+	luaL_unref(L, LUA_REGISTRYINDEX, buffer->stringRef);
+	buffer->stringRef = LUA_NOREF;
+	buffer->closed    = true;
+}
+
+// Pushes the content as a Lua string, the copy is made once and replaces the mapping so the file isn't held open any longer
+static void PushFileBufferString(lua_State* L, FileBuffer* buffer)
+{
+	if (buffer->stringRef == LUA_NOREF)
+	{
+		lua_pushlstring(L, buffer->mapping.data ? buffer->mapping.data : "", buffer->size);
+		lua_pushvalue(L, -1);
+		buffer->stringRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		UnmapFile(buffer->mapping);
+		return;
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, buffer->stringRef);
+}
+
+static const char* FileBufferData(lua_State* L, FileBuffer* buffer)
+{
+	if (buffer->stringRef == LUA_NOREF)
+		return buffer->mapping.data;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, buffer->stringRef);
+	const char* data = lua_tostring(L, -1);
+	lua_pop(L, 1); // The registry keeps the string alive
+	return data;
+}
+
+static int FSFileBufferGC(lua_State* L)
+{
+	FileBuffer* buffer = (FileBuffer*) luaL_checkudata(L, 1, c_FileBufferMetatable);
+	if (!buffer->closed)
+		CloseFileBuffer(L, buffer);
+	return 0;
+}
+
+static int FSFileBufferClose(lua_State* L)
+{
+	return FSFileBufferGC(L);
+}
+
+static int FSFileBufferSize(lua_State* L)
+{
+	lua_pushnumber(L, static_cast<lua_Number>(CheckFileBuffer(L)->size));
+	return 1;
+}
+
+static int FSFileBufferString(lua_State* L)
+{
+	PushFileBufferString(L, CheckFileBuffer(L));
+	return 1;
+}
+
+// Same indexing as string.sub, only the requested range is copied into a string
+static int FSFileBufferSub(lua_State* L)
+{
+	FileBuffer* buffer = CheckFileBuffer(L);
+	lua_Integer size   = static_cast<lua_Integer>(buffer->size);
+	lua_Integer first  = luaL_optinteger(L, 2, 1);
+	lua_Integer last   = luaL_optinteger(L, 3, -1);
+	if (first < 0)
+		first += size + 1;
+	if (last < 0)
+		last += size + 1;
+	if (first < 1)
+		first = 1;
+	if (last > size)
+		last = size;
+	if (first > last)
+	{
+		lua_pushliteral(L, "");
+		return 1;
+	}
+	lua_pushlstring(L, FileBufferData(L, buffer) + (first - 1), static_cast<std::size_t>(last - first + 1));
+	return 1;
+}
+
+// The address of the content for FFI consumers, only valid while the buffer is open and referenced
+static int FSFileBufferPointer(lua_State* L)
+{
+	FileBuffer* buffer = CheckFileBuffer(L);
+	lua_pushlightuserdata(L, const_cast<char*>(FileBufferData(L, buffer)));
+	return 1;
+}
+
+static int FSRead(lua_State* L)
+{
+	if (!lua_isstring(L, 1))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Path has to be a valid string");
+		return 2;
+	}
+
+	FileMapping mapping;
+	if (int error = MapFile(lua_tostring(L, 1), mapping))
+	{
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "Failed to read '%s': %s", lua_tostring(L, 1), std::system_category().message(error).c_str());
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+	FileBuffer* buffer = (FileBuffer*) lua_newuserdata(L, sizeof(FileBuffer));
+	buffer->mapping    = mapping;
+	buffer->size       = mapping.size;
+	buffer->stringRef  = LUA_NOREF;
+	buffer->closed     = false;
+	luaL_getmetatable(L, c_FileBufferMetatable);
+	lua_setmetatable(L, -2);
+	return 2;
+}
+
+// Writes data, a string or a buffer from fs.read, unless the file already holds exactly that.
+// The content goes to a temporary file next to path first and is renamed over it, so readers never see a partial file
+static int FSWriteIfChanged(lua_State* L)
+{
+	if (!lua_isstring(L, 1))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Path has to be a valid string");
+		return 2;
+	}
+
+	const char* path = lua_tostring(L, 1);
+	const char* data = nullptr;
+	std::size_t size = 0;
+	if (FileBuffer* buffer = (FileBuffer*) luaL_testudata(L, 2, c_FileBufferMetatable))
+	{
+		if (buffer->closed)
+		{
+			lua_pushboolean(L, false);
+			lua_pushstring(L, "Data is a closed file buffer");
+			return 2;
+		}
+		data = FileBufferData(L, buffer);
+		size = buffer->size;
+	}
+	else if (lua_type(L, 2) == LUA_TSTRING)
+	{
+		data = lua_tolstring(L, 2, &size);
+	}
+	else
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Data has to be a string or a file buffer");
+		return 2;
+	}
+
+	FileMapping existing;
+	if (MapFile(path, existing) == 0)
+	{
+		bool same = existing.size == size && (size == 0 || std::memcmp(existing.data, data, size) == 0);
+		UnmapFile(existing);
+		if (same)
+		{
+			lua_pushboolean(L, true);
+			lua_pushboolean(L, false);
+			return 2;
+		}
+	}
+
+	std::error_code       ec;
+	std::filesystem::path target = path;
+	if (target.has_parent_path())
+		std::filesystem::create_directories(target.parent_path(), ec);
+
+#if BUILD_IS_SYSTEM_WINDOWS
+	unsigned long processId = GetCurrentProcessId();
+#else
+	unsigned long processId = static_cast<unsigned long>(::getpid());
+#endif
+	std::string temp = std::string(path) + ".tmp" + std::to_string(processId);
+	std::FILE*  file = std::fopen(temp.c_str(), "wb");
+	if (!file)
+	{
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "Failed to open '%s' for writing: %s", temp.c_str(), std::system_category().message(LastSystemError()).c_str());
+		return 2;
+	}
+	bool written = std::fwrite(data, 1, size, file) == size;
+	written      = std::fclose(file) == 0 && written;
+	// The temp file replaces the existing one, so it takes over its permissions, like the exec bit of a generated script
+	std::error_code statusEC;
+	auto            status = std::filesystem::status(target, statusEC);
+	if (written && !statusEC && std::filesystem::exists(status))
+		std::filesystem::permissions(temp, status.permissions(), std::filesystem::perm_options::replace, ec);
+	if (written && !ec)
+		std::filesystem::rename(temp, target, ec);
+	if (!written || ec)
+	{
+		std::error_code removeEC;
+		std::filesystem::remove(temp, removeEC);
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "Failed to write '%s': %s", path, written ? ec.message().c_str() : "write error");
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	lua_pushboolean(L, true);
+	return 2;
+}
+
+// Tree removal for fs.remove_trees. Removing is mostly waiting on the filesystem, so a pool of threads empties directories
+// concurrently: every directory taken from the queue has its files unlinked and its subdirectories queued. The emptied
+// directories are removed afterwards, deepest first, as a directory can only go once all of its children are gone.
+struct TreeDirectory
+{
+	std::string path;
+	std::size_t depth;
+};
+
+struct TreeRemoval
+{
+	std::mutex                 mutex;
+	std::condition_variable    wake;
+	std::vector<TreeDirectory> pending;
+	std::vector<TreeDirectory> emptied;
+	std::size_t                busy = 0;
+	std::atomic<std::uint64_t> removed { 0 };
+	std::string                error; // First failure, the removal goes on to remove as much as possible
+};
+
+static void TreeRemovalError(TreeRemoval& removal, const std::string& path, int error)
+{
+	std::lock_guard lock(removal.mutex);
+	if (removal.error.empty())
+		removal.error = "Failed to remove '" + path + "': " + std::system_category().message(error);
+}
+
+static void EmptyTreeDirectory(TreeRemoval& removal, const TreeDirectory& directory)
+{
+	std::vector<TreeDirectory> subdirectories;
+#if BUILD_IS_SYSTEM_WINDOWS
+	std::error_code                     ec;
+	std::filesystem::directory_iterator iter(directory.path, ec);
+	for (; !ec && iter != std::filesystem::directory_iterator {}; iter.increment(ec))
+	{
+		std::error_code entryEC;
+		if (iter->is_directory(entryEC) && !iter->is_symlink(entryEC))
+		{
+			subdirectories.push_back({ iter->path().string(), directory.depth + 1 });
+		}
+		else if (std::filesystem::remove(iter->path(), entryEC))
+		{
+			++removal.removed;
+		}
+		else if (entryEC)
+		{
+			TreeRemovalError(removal, iter->path().string(), entryEC.value());
+		}
+	}
+	if (ec)
+		TreeRemovalError(removal, directory.path, ec.value());
+#else
+	int  fd  = ::open(directory.path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	DIR* dir = fd >= 0 ? ::fdopendir(fd) : nullptr;
+	if (!dir)
+	{
+		TreeRemovalError(removal, directory.path, LastSystemError());
+		if (fd >= 0)
+			::close(fd);
+		return;
+	}
+	while (dirent* entry = ::readdir(dir))
+	{
+		const char* name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		bool isDirectory = entry->d_type == DT_DIR;
+		if (entry->d_type == DT_UNKNOWN)
+		{
+			struct stat st {};
+			isDirectory = ::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+		}
+		if (isDirectory)
+			subdirectories.push_back({ directory.path + "/" + name, directory.depth + 1 });
+		else if (::unlinkat(fd, name, 0) == 0)
+			++removal.removed;
+		else if (errno != ENOENT)
+			TreeRemovalError(removal, directory.path + "/" + name, LastSystemError());
+	}
+	::closedir(dir);
+#endif
+
+	std::lock_guard lock(removal.mutex);
+	removal.emptied.push_back(directory);
+	for (auto& subdirectory : subdirectories)
+		removal.pending.push_back(std::move(subdirectory));
+}
+
+static void TreeRemovalWorker(TreeRemoval& removal)
+{
+	std::unique_lock lock(removal.mutex);
+	while (true)
+	{
+		removal.wake.wait(lock, [&removal]() { return !removal.pending.empty() || removal.busy == 0; });
+		if (removal.pending.empty())
+			break;
+
+		TreeDirectory directory = std::move(removal.pending.back());
+		removal.pending.pop_back();
+		++removal.busy;
+		lock.unlock();
+		EmptyTreeDirectory(removal, directory);
+		lock.lock();
+		--removal.busy;
+		removal.wake.notify_all();
+	}
+}
+
+static void RemoveEmptiedDirectory(TreeRemoval& removal, const TreeDirectory& directory)
+{
+#if BUILD_IS_SYSTEM_WINDOWS
+	std::error_code ec;
+	if (std::filesystem::remove(directory.path, ec))
+		++removal.removed;
+	else if (ec)
+		TreeRemovalError(removal, directory.path, ec.value());
+#else
+	if (::rmdir(directory.path.c_str()) == 0)
+		++removal.removed;
+	else if (errno != ENOENT)
+		TreeRemovalError(removal, directory.path, LastSystemError());
+#endif
+}
+
+// fs.remove_trees(paths[, jobs]) removes files and whole directory trees, symlinks are removed, not followed.
+// Returns true and the number of removed entries like fs.remove_all, paths that don't exist are skipped
+static int FSRemoveTrees(lua_State* L)
+{
+	if (!lua_istable(L, 1))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, "Paths have to be a table of strings");
+		return 2;
+	}
+	std::size_t jobs = lua_isnumber(L, 2) ? static_cast<std::size_t>(std::max<lua_Integer>(1, lua_tointeger(L, 2))) : std::max(1U, std::thread::hardware_concurrency());
+
+	TreeRemoval removal;
+	std::size_t count = lua_objlen(L, 1);
+	for (std::size_t i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, 1, static_cast<int>(i));
+		if (!lua_isstring(L, -1))
+		{
+			lua_pushboolean(L, false);
+			lua_pushfstring(L, "Path %d has to be a valid string", static_cast<int>(i));
+			return 2;
+		}
+		std::string path = lua_tostring(L, -1);
+		lua_pop(L, 1);
+
+		std::error_code       ec;
+		std::filesystem::path target = path;
+		auto                  status = std::filesystem::symlink_status(target, ec);
+		if (status.type() == std::filesystem::file_type::not_found)
+			continue;
+		if (status.type() == std::filesystem::file_type::directory)
+		{
+			while (path.size() > 1 && (path.back() == '/' || path.back() == '\\'))
+				path.pop_back();
+			removal.pending.push_back({ std::move(path), 0 });
+		}
+		else if (std::filesystem::remove(target, ec))
+		{
+			++removal.removed;
+		}
+		else if (ec)
+		{
+			TreeRemovalError(removal, path, ec.value());
+		}
+	}
+
+	if (!removal.pending.empty())
+	{
+		std::vector<std::thread> threads;
+		for (std::size_t i = 1; i < jobs; ++i)
+			threads.emplace_back(&TreeRemovalWorker, std::ref(removal));
+		TreeRemovalWorker(removal);
+		for (auto& thread : threads)
+			thread.join();
+
+		// Directories of one depth don't contain each other, so every level is removed in parallel before the one above it
+		std::sort(removal.emptied.begin(), removal.emptied.end(), [](const TreeDirectory& lhs, const TreeDirectory& rhs) { return lhs.depth > rhs.depth; });
+		for (std::size_t first = 0; first < removal.emptied.size();)
+		{
+			std::size_t last = first;
+			while (last < removal.emptied.size() && removal.emptied[last].depth == removal.emptied[first].depth)
+				++last;
+
+			std::atomic<std::size_t> next = first;
+			auto                     work = [&removal, &next, last]() {
+				for (std::size_t index = next++; index < last; index = next++)
+					RemoveEmptiedDirectory(removal, removal.emptied[index]);
+			};
+			std::size_t levelJobs = std::min(jobs, (last - first + 63) / 64);
+			threads.clear();
+			for (std::size_t i = 1; i < levelJobs; ++i)
+				threads.emplace_back(work);
+			work();
+			for (auto& thread : threads)
+				thread.join();
+			first = last;
+		}
+	}
+
+	if (!removal.error.empty())
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, removal.error.c_str());
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	lua_pushinteger(L, static_cast<lua_Integer>(removal.removed.load()));
+	return 2;
+}
+
 void AddFilesystemLib(lua_State* L)
 {
+	luaL_newmetatable(L, c_DirectoryIteratorMetatable);
+	lua_pushcfunction(L, &FSDirectoryIteratorClose);
+	lua_setfield(L, -2, "__gc");
+	lua_createtable(L, 0, 1);
+	lua_pushcfunction(L, &FSDirectoryIteratorClose);
+	lua_setfield(L, -2, "close");
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+
+	luaL_newmetatable(L, c_FileBufferMetatable);
+	lua_pushcfunction(L, &FSFileBufferGC);
+	lua_setfield(L, -2, "__gc");
+	lua_pushcfunction(L, &FSFileBufferSize);
+	lua_setfield(L, -2, "__len");
+	lua_pushcfunction(L, &FSFileBufferString);
+	lua_setfield(L, -2, "__tostring");
+	lua_createtable(L, 0, 5);
+	lua_pushcfunction(L, &FSFileBufferClose);
+	lua_setfield(L, -2, "close");
+	lua_pushcfunction(L, &FSFileBufferSize);
+	lua_setfield(L, -2, "size");
+	lua_pushcfunction(L, &FSFileBufferString);
+	lua_setfield(L, -2, "string");
+	lua_pushcfunction(L, &FSFileBufferSub);
+	lua_setfield(L, -2, "sub");
+	lua_pushcfunction(L, &FSFileBufferPointer);
+	lua_setfield(L, -2, "pointer");
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+
 	lua_createtable(L, 0, 1);
 
 	lua_pushcfunction(L, &FSAppend);
@@ -1457,6 +2264,8 @@ void AddFilesystemLib(lua_State* L)
 	lua_setfield(L, -2, "remove");
 	lua_pushcfunction(L, &FSRemoveAll);
 	lua_setfield(L, -2, "remove_all");
+	lua_pushcfunction(L, &FSRemoveTrees);
+	lua_setfield(L, -2, "remove_trees");
 	lua_pushcfunction(L, &FSRename);
 	lua_setfield(L, -2, "rename");
 	lua_pushcfunction(L, &FSResizeFile);
@@ -1491,6 +2300,14 @@ void AddFilesystemLib(lua_State* L)
 	lua_setfield(L, -2, "directory_iterator");
 	lua_pushcfunction(L, &FSRecursiveDirectoryIterator);
 	lua_setfield(L, -2, "recursive_directory_iterator");
+	lua_pushcfunction(L, &FSDirectoryStamp);
+	lua_setfield(L, -2, "directory_stamp");
+	lua_pushcfunction(L, &FSScanDirectory);
+	lua_setfield(L, -2, "scan_directory");
+	lua_pushcfunction(L, &FSRead);
+	lua_setfield(L, -2, "read");
+	lua_pushcfunction(L, &FSWriteIfChanged);
+	lua_setfield(L, -2, "write_if_changed");
 
 	lua_setglobal(L, "fs");
 }
\ No newline at end of file
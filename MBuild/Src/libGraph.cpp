@@ -0,0 +1,816 @@
+#include <lua.hpp>
+
+#include <Build.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Build graph of a build file written by MBuild.Ninja, laid out as flat arrays so millions of nodes stay cheap to load and
+// keep. Paths and strings are interned into pools and referred to by 32 bit ids, the inputs and outputs of edges and the
+// consumers of nodes are CSR ranges into shared id arrays. Lua only sees the graph userdata and 1 based node and edge ids.
+
+static constexpr const char*   c_GraphMetatable = "graph.graph";
+static constexpr std::uint32_t c_None           = 0xFFFF'FFFF;
+
+// Interned strings, string id -> data[offsets[id], offsets[id + 1]), the hash table is open addressing over string ids
+struct StringPool
+{
+	std::string                data;
+	std::vector<std::uint32_t> offsets { 0 };
+	std::vector<std::uint32_t> slots; // c_None for empty slots, power of two sized
+};
+
+static std::uint64_t HashString(std::string_view str)
+{
+	std::uint64_t hash = 0xCBF2'9CE4'8422'2325ULL; // FNV-1a
+	for (char c : str)
+		hash = (hash ^ static_cast<unsigned char>(c)) * 0x100'0000'01B3ULL;
+	return hash;
+}
+
+static std::uint32_t PoolCount(const StringPool& pool)
+{
+	return static_cast<std::uint32_t>(pool.offsets.size() - 1);
+}
+
+static std::string_view PoolString(const StringPool& pool, std::uint32_t id)
+{
+	return std::string_view(pool.data).substr(pool.offsets[id], pool.offsets[id + 1] - pool.offsets[id]);
+}
+
+// Returns the slot holding str, or the empty slot it would go into
+static std::size_t PoolSlot(const StringPool& pool, std::string_view str)
+{
+	std::size_t mask = pool.slots.size() - 1;
+	std::size_t slot = static_cast<std::size_t>(HashString(str)) & mask;
+	while (pool.slots[slot] != c_None && PoolString(pool, pool.slots[slot]) != str)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+static std::uint32_t PoolFind(const StringPool& pool, std::string_view str)
+{
+	if (pool.slots.empty())
+		return c_None;
+	return pool.slots[PoolSlot(pool, str)];
+}
+
+static std::uint32_t PoolIntern(StringPool& pool, std::string_view str)
+{
+	// Kept at most half full, probes stay short without storing the hashes
+	if ((PoolCount(pool) + 1) * 2 > pool.slots.size())
+	{
+		pool.slots.assign(pool.slots.empty() ? 1024 : pool.slots.size() * 2, c_None);
+		for (std::uint32_t id = 0; id < PoolCount(pool); ++id)
+			pool.slots[PoolSlot(pool, PoolString(pool, id))] = id;
+	}
+
+	std::size_t slot = PoolSlot(pool, str);
+	if (pool.slots[slot] != c_None)
+		return pool.slots[slot];
+	if (pool.data.size() + str.size() > c_None)
+		throw "String pool of the build graph exceeds 4 GiB";
+
+	std::uint32_t id = PoolCount(pool);
+	pool.data.append(str);
+	pool.offsets.push_back(static_cast<std::uint32_t>(pool.data.size()));
+	pool.slots[slot] = id;
+	return id;
+}
+
+static std::size_t PoolMemory(const StringPool& pool)
+{
+	return pool.data.capacity() + (pool.offsets.capacity() + pool.slots.capacity()) * sizeof(std::uint32_t);
+}
+
+struct BuildGraph
+{
+	StringPool paths;   // Node id -> path
+	StringPool strings; // Rules, projects and the names and values of edge variables
+
+	std::vector<std::uint32_t> nodeProducer;      // Edge producing the node, c_None for sources
+	std::vector<std::uint32_t> nodeConsumerStart; // CSR into consumers
+	std::vector<std::uint32_t> consumers;
+
+	std::vector<std::uint32_t> edgeRule;
+	std::vector<std::uint32_t> edgeProject;             // c_None before the first "# Project" comment
+	std::vector<std::uint32_t> edgeOutputStart { 0 };   // CSR into outputs, explicit and implicit outputs
+	std::vector<std::uint32_t> outputs;
+	std::vector<std::uint32_t> edgeInputStart { 0 };    // CSR into inputs, explicit then implicit then order only inputs
+	std::vector<std::uint32_t> edgeImplicitStart;       // First implicit input of the edge
+	std::vector<std::uint32_t> edgeOrderOnlyStart;      // First order only input of the edge
+	std::vector<std::uint32_t> inputs;
+	std::vector<std::uint32_t> edgeVariableStart { 0 }; // CSR into variables, pairs of name and value string ids
+	std::vector<std::uint32_t> variables;
+
+	std::vector<std::uint32_t> defaults;
+};
+
+struct GraphHandle // Userdata returned by graph.load, null once closed
+{
+	BuildGraph* graph;
+};
+
+template <class T>
+static std::size_t VectorMemory(const std::vector<T>& vector)
+{
+	return vector.capacity() * sizeof(T);
+}
+
+static std::size_t GraphMemory(const BuildGraph& graph)
+{
+	return sizeof(BuildGraph) + PoolMemory(graph.paths) + PoolMemory(graph.strings) +
+		   VectorMemory(graph.nodeProducer) + VectorMemory(graph.nodeConsumerStart) + VectorMemory(graph.consumers) +
+		   VectorMemory(graph.edgeRule) + VectorMemory(graph.edgeProject) + VectorMemory(graph.edgeOutputStart) +
+		   VectorMemory(graph.outputs) + VectorMemory(graph.edgeInputStart) + VectorMemory(graph.edgeImplicitStart) +
+		   VectorMemory(graph.edgeOrderOnlyStart) + VectorMemory(graph.inputs) + VectorMemory(graph.edgeVariableStart) +
+		   VectorMemory(graph.variables) + VectorMemory(graph.defaults);
+}
+
+using Bindings = std::vector<std::pair<std::string, std::string>>;
+
+struct Parser
+{
+	std::string_view content;
+	std::size_t      pos  = 0;
+	std::size_t      line = 0;
+	std::string_view current;        // Line being parsed, a view into content unless it was joined into logical
+	bool             joined = false;
+	std::string      logical;        // Line joined over "$\n" continuations
+
+	std::unordered_map<std::string, std::string> globals;
+	std::string                                  message;
+
+	// Reused by every edge, so parsing doesn't allocate per line
+	Bindings                      scope;
+	std::size_t                   scopeSize = 0;
+	std::string                   header;
+	std::vector<std::string_view> outs;
+	std::vector<std::string_view> rest;
+	std::string                   path;
+};
+
+static bool IsVariableChar(char c, bool braced)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || (braced && c == '.');
+}
+
+// Reads the next logical line into parser.current, false at the end of the content
+static bool ReadLine(Parser& parser)
+{
+	if (parser.pos >= parser.content.size())
+		return false;
+
+	parser.joined  = false;
+	bool continued = false;
+	while (parser.pos < parser.content.size())
+	{
+		std::size_t end = parser.content.find('\n', parser.pos);
+		if (end == std::string_view::npos)
+			end = parser.content.size();
+		std::string_view line = parser.content.substr(parser.pos, end - parser.pos);
+		parser.pos            = end + 1;
+		++parser.line;
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+		if (continued)
+			line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
+
+		// An odd number of trailing '$' escapes the line break
+		std::size_t dollars = 0;
+		while (dollars < line.size() && line[line.size() - 1 - dollars] == '$')
+			++dollars;
+		bool more = dollars % 2 == 1;
+		if (more)
+			line.remove_suffix(1);
+		if (!more && !continued)
+		{
+			parser.current = line;
+			return true;
+		}
+		if (!continued)
+			parser.logical.clear();
+		parser.logical.append(line);
+		continued = more;
+		if (!continued)
+			break;
+	}
+	parser.current = parser.logical;
+	parser.joined  = true;
+	return true;
+}
+
+static bool Fail(Parser& parser, const char* message)
+{
+	parser.message = "line " + std::to_string(parser.line) + ": " + message;
+	return false;
+}
+
+static const std::string* Lookup(const Parser& parser, bool edgeScope, std::string_view name)
+{
+	if (edgeScope)
+	{
+		for (std::size_t i = 0; i < parser.scopeSize; ++i)
+			if (parser.scope[i].first == name)
+				return &parser.scope[i].second;
+	}
+	auto itr = parser.globals.find(std::string(name));
+	return itr != parser.globals.end() ? &itr->second : nullptr;
+}
+
+// Appends str with escapes resolved and variables expanded, the edge scope goes before the globals
+static bool Evaluate(Parser& parser, std::string_view str, bool edgeScope, std::string& out)
+{
+	if (str.find('$') == std::string_view::npos)
+	{
+		out.append(str);
+		return true;
+	}
+	for (std::size_t i = 0; i < str.size(); ++i)
+	{
+		char c = str[i];
+		if (c != '$')
+		{
+			out.push_back(c);
+			continue;
+		}
+		if (++i == str.size())
+			return Fail(parser, "Unexpected '$' at the end of the line");
+
+		c = str[i];
+		if (c == '$' || c == ' ' || c == ':')
+		{
+			out.push_back(c);
+			continue;
+		}
+
+		bool        braced = c == '{';
+		std::size_t start  = braced ? i + 1 : i;
+		std::size_t end    = start;
+		while (end < str.size() && IsVariableChar(str[end], braced))
+			++end;
+		if (end == start || (braced && (end == str.size() || str[end] != '}')))
+			return Fail(parser, "Bad '$' escape");
+		if (const std::string* value = Lookup(parser, edgeScope, str.substr(start, end - start)))
+			out.append(*value);
+		i = braced ? end : end - 1;
+	}
+	return true;
+}
+
+// Splits at the spaces that aren't escaped, escapes are left for Evaluate
+static void SplitPaths(std::string_view str, std::vector<std::string_view>& paths)
+{
+	std::size_t start = 0;
+	for (std::size_t i = 0; i <= str.size(); ++i)
+	{
+		if (i == str.size() || str[i] == ' ')
+		{
+			if (i > start)
+				paths.push_back(str.substr(start, i - start));
+			start = i + 1;
+		}
+		else if (str[i] == '$')
+		{
+			++i;
+		}
+	}
+}
+
+// Parses "name = value", the value isn't evaluated
+static bool ParseBinding(Parser& parser, std::string_view line, std::string& name, std::string_view& value)
+{
+	std::size_t begin = line.find_first_not_of(' ');
+	std::size_t end   = begin;
+	while (end < line.size() && IsVariableChar(line[end], true))
+		++end;
+	std::size_t equals = line.find_first_not_of(' ', end);
+	if (begin == std::string_view::npos || end == begin || equals == std::string_view::npos || line[equals] != '=')
+		return Fail(parser, "Expected 'name = value'");
+	name.assign(line.substr(begin, end - begin));
+	value = line.substr(std::min(line.find_first_not_of(' ', equals + 1), line.size()));
+	return true;
+}
+
+static bool IsIndented(const Parser& parser)
+{
+	return parser.pos < parser.content.size() && parser.content[parser.pos] == ' ';
+}
+
+static bool SkipBlock(Parser& parser)
+{
+	while (IsIndented(parser))
+		ReadLine(parser);
+	return true;
+}
+
+static bool ParseEdge(Parser& parser, BuildGraph& graph, std::uint32_t project)
+{
+	// Reading the edge's variables replaces a joined line, so only that one has to be copied
+	std::string_view header = parser.current.substr(6);
+	if (parser.joined)
+	{
+		parser.header.assign(header);
+		header = parser.header;
+	}
+
+	// The first ':' that isn't escaped separates the outputs from the rule and the inputs
+	std::size_t colon = std::string::npos;
+	for (std::size_t i = 0; i < header.size(); ++i)
+	{
+		if (header[i] == '$')
+		{
+			++i;
+		}
+		else if (header[i] == ':')
+		{
+			colon = i;
+			break;
+		}
+	}
+	if (colon == std::string::npos)
+		return Fail(parser, "Expected ':' in build statement");
+
+	std::vector<std::string_view>& outs = parser.outs;
+	std::vector<std::string_view>& rest = parser.rest;
+	outs.clear();
+	rest.clear();
+	SplitPaths(header.substr(0, colon), outs);
+	SplitPaths(header.substr(colon + 1), rest);
+	if (rest.empty())
+		return Fail(parser, "Expected a rule in build statement");
+
+	// Edge variables are in scope for the paths of the edge
+	parser.scopeSize = 0;
+	while (IsIndented(parser))
+	{
+		ReadLine(parser);
+		if (parser.current.find_first_not_of(' ') == std::string_view::npos)
+			continue;
+		if (parser.scopeSize == parser.scope.size())
+			parser.scope.emplace_back();
+		auto&            binding = parser.scope[parser.scopeSize];
+		std::string_view raw;
+		if (!ParseBinding(parser, parser.current, binding.first, raw))
+			return false;
+		binding.second.clear();
+		if (!Evaluate(parser, raw, false, binding.second))
+			return false;
+		++parser.scopeSize;
+	}
+
+	graph.edgeRule.push_back(PoolIntern(graph.strings, rest[0]));
+	graph.edgeProject.push_back(project);
+
+	std::string& path = parser.path;
+	for (std::string_view raw : outs)
+	{
+		if (raw == "|")
+			continue;
+		path.clear();
+		if (!Evaluate(parser, raw, true, path))
+			return false;
+		graph.outputs.push_back(PoolIntern(graph.paths, path));
+	}
+	graph.edgeOutputStart.push_back(static_cast<std::uint32_t>(graph.outputs.size()));
+
+	// Validations, "|@", don't gate the edge and aren't kept
+	std::uint32_t implicitStart  = c_None;
+	std::uint32_t orderOnlyStart = c_None;
+	bool          validations    = false;
+	for (std::size_t i = 1; i < rest.size() && !validations; ++i)
+	{
+		std::string_view raw = rest[i];
+		if (raw == "|")
+		{
+			implicitStart = static_cast<std::uint32_t>(graph.inputs.size());
+		}
+		else if (raw == "||")
+		{
+			orderOnlyStart = static_cast<std::uint32_t>(graph.inputs.size());
+		}
+		else if (raw == "|@")
+		{
+			validations = true;
+		}
+		else
+		{
+			path.clear();
+			if (!Evaluate(parser, raw, true, path))
+				return false;
+			graph.inputs.push_back(PoolIntern(graph.paths, path));
+		}
+	}
+	std::uint32_t end = static_cast<std::uint32_t>(graph.inputs.size());
+	if (orderOnlyStart == c_None)
+		orderOnlyStart = end;
+	if (implicitStart == c_None)
+		implicitStart = orderOnlyStart;
+	graph.edgeImplicitStart.push_back(implicitStart);
+	graph.edgeOrderOnlyStart.push_back(orderOnlyStart);
+	graph.edgeInputStart.push_back(end);
+
+	for (std::size_t i = 0; i < parser.scopeSize; ++i)
+	{
+		graph.variables.push_back(PoolIntern(graph.strings, parser.scope[i].first));
+		graph.variables.push_back(PoolIntern(graph.strings, parser.scope[i].second));
+	}
+	graph.edgeVariableStart.push_back(static_cast<std::uint32_t>(graph.variables.size()));
+	return true;
+}
+
+static bool ParseDefault(Parser& parser, BuildGraph& graph)
+{
+	std::vector<std::string_view> raws;
+	SplitPaths(parser.current.substr(8), raws);
+	std::string path;
+	for (std::string_view raw : raws)
+	{
+		path.clear();
+		if (!Evaluate(parser, raw, false, path))
+			return false;
+		graph.defaults.push_back(PoolIntern(graph.paths, path));
+	}
+	return true;
+}
+
+// Producers and the consumer CSR can only be filled once every edge is known
+static bool LinkNodes(Parser& parser, BuildGraph& graph)
+{
+	std::uint32_t nodes = PoolCount(graph.paths);
+	std::uint32_t edges = static_cast<std::uint32_t>(graph.edgeRule.size());
+
+	graph.nodeProducer.assign(nodes, c_None);
+	for (std::uint32_t edge = 0; edge < edges; ++edge)
+	{
+		for (std::uint32_t i = graph.edgeOutputStart[edge]; i < graph.edgeOutputStart[edge + 1]; ++i)
+		{
+			std::uint32_t node = graph.outputs[i];
+			if (graph.nodeProducer[node] != c_None)
+			{
+				parser.message = "Multiple edges generate '" + std::string(PoolString(graph.paths, node)) + "'";
+				return false;
+			}
+			graph.nodeProducer[node] = edge;
+		}
+	}
+
+	graph.nodeConsumerStart.assign(nodes + 1, 0);
+	for (std::uint32_t node : graph.inputs)
+		++graph.nodeConsumerStart[node + 1];
+	for (std::uint32_t node = 0; node < nodes; ++node)
+		graph.nodeConsumerStart[node + 1] += graph.nodeConsumerStart[node];
+
+	// Filled back to front so every node's consumers end up in edge order
+	graph.consumers.resize(graph.inputs.size());
+	std::vector<std::uint32_t> fill(graph.nodeConsumerStart.begin() + 1, graph.nodeConsumerStart.end());
+	for (std::uint32_t edge = edges; edge-- > 0;)
+	{
+		for (std::uint32_t i = graph.edgeInputStart[edge + 1]; i-- > graph.edgeInputStart[edge];)
+			graph.consumers[--fill[graph.inputs[i]]] = edge;
+	}
+	return true;
+}
+
+static bool ParseGraph(Parser& parser, BuildGraph& graph)
+{
+	std::uint32_t project = c_None;
+	while (ReadLine(parser))
+	{
+		std::string_view line = parser.current;
+		if (line.empty())
+			continue;
+
+		if (line[0] == '#')
+		{
+			// MBuild.Ninja starts the edges of every project with this comment
+			if (line.substr(0, 10) == "# Project ")
+				project = PoolIntern(graph.strings, line.substr(10));
+		}
+		else if (line.substr(0, 6) == "build ")
+		{
+			if (!ParseEdge(parser, graph, project))
+				return false;
+		}
+		else if (line.substr(0, 5) == "rule " || line.substr(0, 5) == "pool ")
+		{
+			SkipBlock(parser);
+		}
+		else if (line.substr(0, 8) == "default ")
+		{
+			if (!ParseDefault(parser, graph))
+				return false;
+		}
+		else if (line.substr(0, 8) == "include " || line.substr(0, 9) == "subninja ")
+		{
+			return Fail(parser, "include and subninja aren't supported");
+		}
+		else if (line[0] == ' ')
+		{
+			if (line.find_first_not_of(' ') != std::string_view::npos)
+				return Fail(parser, "Unexpected indentation");
+		}
+		else
+		{
+			std::string      name;
+			std::string_view raw;
+			if (!ParseBinding(parser, line, name, raw))
+				return false;
+			std::string value;
+			if (!Evaluate(parser, raw, false, value))
+				return false;
+			parser.globals[name] = std::move(value);
+		}
+	}
+	return LinkNodes(parser, graph);
+}
+
+static void ShrinkGraph(BuildGraph& graph)
+{
+	for (auto* vector : { &graph.paths.offsets, &graph.strings.offsets, &graph.nodeProducer, &graph.nodeConsumerStart, &graph.consumers, &graph.edgeRule, &graph.edgeProject, &graph.edgeOutputStart, &graph.outputs, &graph.edgeInputStart, &graph.edgeImplicitStart, &graph.edgeOrderOnlyStart, &graph.inputs, &graph.edgeVariableStart, &graph.variables, &graph.defaults })
+		vector->shrink_to_fit();
+	graph.paths.data.shrink_to_fit();
+	graph.strings.data.shrink_to_fit();
+}
+
+static BuildGraph* CheckGraph(lua_State* L)
+{
+	GraphHandle* handle = (GraphHandle*) luaL_checkudata(L, 1, c_GraphMetatable);
+	if (!handle->graph)
+		luaL_error(L, "Attempt to use a closed build graph");
+	return handle->graph;
+}
+
+static std::uint32_t CheckNode(lua_State* L, BuildGraph* graph, int index)
+{
+	lua_Integer node = luaL_checkinteger(L, index);
+	if (node < 1 || node > static_cast<lua_Integer>(PoolCount(graph->paths)))
+		luaL_argerror(L, index, "Node id out of range");
+	return static_cast<std::uint32_t>(node - 1);
+}
+
+static std::uint32_t CheckEdge(lua_State* L, BuildGraph* graph, int index)
+{
+	lua_Integer edge = luaL_checkinteger(L, index);
+	if (edge < 1 || edge > static_cast<lua_Integer>(graph->edgeRule.size()))
+		luaL_argerror(L, index, "Edge id out of range");
+	return static_cast<std::uint32_t>(edge - 1);
+}
+
+static void PushString(lua_State* L, const StringPool& pool, std::uint32_t id)
+{
+	std::string_view str = PoolString(pool, id);
+	lua_pushlstring(L, str.data(), str.size());
+}
+
+// Pushes the ids in [first, last) as an array of 1 based ids
+static void PushIds(lua_State* L, const std::vector<std::uint32_t>& ids, std::uint32_t first, std::uint32_t last)
+{
+	lua_createtable(L, static_cast<int>(last - first), 0);
+	for (std::uint32_t i = first; i < last; ++i)
+	{
+		lua_pushinteger(L, static_cast<lua_Integer>(ids[i]) + 1);
+		lua_rawseti(L, -2, static_cast<int>(i - first + 1));
+	}
+}
+
+// Wall time matters more than peak memory here, the whole file is read at once and parsed in place
+static int GraphLoad(lua_State* L)
+{
+	const char* path = luaL_checkstring(L, 1);
+
+	std::string content;
+	FILE*       file = std::fopen(path, "rb");
+	if (!file)
+	{
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "Failed to open '%s': %s", path, std::strerror(errno));
+		return 2;
+	}
+	std::fseek(file, 0, SEEK_END);
+	long size = std::ftell(file);
+	std::fseek(file, 0, SEEK_SET);
+	content.resize(size > 0 ? static_cast<std::size_t>(size) : 0);
+	content.resize(std::fread(content.data(), 1, content.size(), file));
+	std::fclose(file);
+
+	// Owned by the userdata from the start, so __gc frees it when parsing throws
+	GraphHandle* handle = (GraphHandle*) lua_newuserdata(L, sizeof(GraphHandle));
+	handle->graph       = nullptr;
+	luaL_getmetatable(L, c_GraphMetatable);
+	lua_setmetatable(L, -2);
+	handle->graph     = new BuildGraph();
+	BuildGraph* graph = handle->graph;
+
+	Parser parser;
+	parser.content = content;
+	if (!ParseGraph(parser, *graph))
+	{
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "Failed to load build graph '%s': %s", path, parser.message.c_str());
+		return 2;
+	}
+	ShrinkGraph(*graph);
+	lua_pushboolean(L, true);
+	lua_insert(L, -2);
+	return 2;
+}
+
+static int GraphGC(lua_State* L)
+{
+	GraphHandle* handle = (GraphHandle*) luaL_checkudata(L, 1, c_GraphMetatable);
+	delete handle->graph;
+	handle->graph = nullptr;
+	return 0;
+}
+
+static int GraphClose(lua_State* L)
+{
+	return GraphGC(L);
+}
+
+static int GraphNodeCount(lua_State* L)
+{
+	lua_pushinteger(L, static_cast<lua_Integer>(PoolCount(CheckGraph(L)->paths)));
+	return 1;
+}
+
+static int GraphEdgeCount(lua_State* L)
+{
+	lua_pushinteger(L, static_cast<lua_Integer>(CheckGraph(L)->edgeRule.size()));
+	return 1;
+}
+
+// Bytes held by the graph, the layout aims at well below 200 bytes per node
+static int GraphMemoryUsage(lua_State* L)
+{
+	lua_pushnumber(L, static_cast<lua_Number>(GraphMemory(*CheckGraph(L))));
+	return 1;
+}
+
+static int GraphNode(lua_State* L)
+{
+	BuildGraph*   graph = CheckGraph(L);
+	std::size_t   size;
+	const char*   path = luaL_checklstring(L, 2, &size);
+	std::uint32_t node = PoolFind(graph->paths, std::string_view(path, size));
+	if (node == c_None)
+		return 0;
+	lua_pushinteger(L, static_cast<lua_Integer>(node) + 1);
+	return 1;
+}
+
+static int GraphPath(lua_State* L)
+{
+	BuildGraph* graph = CheckGraph(L);
+	PushString(L, graph->paths, CheckNode(L, graph, 2));
+	return 1;
+}
+
+static int GraphProducer(lua_State* L)
+{
+	BuildGraph*   graph = CheckGraph(L);
+	std::uint32_t edge  = graph->nodeProducer[CheckNode(L, graph, 2)];
+	if (edge == c_None)
+		return 0;
+	lua_pushinteger(L, static_cast<lua_Integer>(edge) + 1);
+	return 1;
+}
+
+static int GraphConsumers(lua_State* L)
+{
+	BuildGraph*   graph = CheckGraph(L);
+	std::uint32_t node  = CheckNode(L, graph, 2);
+	PushIds(L, graph->consumers, graph->nodeConsumerStart[node], graph->nodeConsumerStart[node + 1]);
+	return 1;
+}
+
+static int GraphOutputs(lua_State* L)
+{
+	BuildGraph*   graph = CheckGraph(L);
+	std::uint32_t edge  = CheckEdge(L, graph, 2);
+	PushIds(L, graph->outputs, graph->edgeOutputStart[edge], graph->edgeOutputStart[edge + 1]);
+	return 1;
+}
+
+// inputs(edge[, kind]), kind is "explicit", "implicit" or "order_only", all inputs without it
+static int GraphInputs(lua_State* L)
+{
+	static const char* const kinds[] = { "all", "explicit", "implicit", "order_only", nullptr };
+
+	BuildGraph*   graph = CheckGraph(L);
+	std::uint32_t edge  = CheckEdge(L, graph, 2);
+	int           kind  = luaL_checkoption(L, 3, "all", kinds);
+	std::uint32_t first = graph->edgeInputStart[edge];
+	std::uint32_t last  = graph->edgeInputStart[edge + 1];
+	switch (kind)
+	{
+	case 1: last = graph->edgeImplicitStart[edge]; break;
+	case 2:
+		first = graph->edgeImplicitStart[edge];
+		last  = graph->edgeOrderOnlyStart[edge];
+		break;
+	case 3: first = graph->edgeOrderOnlyStart[edge]; break;
+	}
+	PushIds(L, graph->inputs, first, last);
+	return 1;
+}
+
+static int GraphRule(lua_State* L)
+{
+	BuildGraph* graph = CheckGraph(L);
+	PushString(L, graph->strings, graph->edgeRule[CheckEdge(L, graph, 2)]);
+	return 1;
+}
+
+static int GraphProject(lua_State* L)
+{
+	BuildGraph*   graph   = CheckGraph(L);
+	std::uint32_t project = graph->edgeProject[CheckEdge(L, graph, 2)];
+	if (project == c_None)
+		return 0;
+	PushString(L, graph->strings, project);
+	return 1;
+}
+
+// variable(edge, name), only the variables bound on the edge itself, already evaluated
+static int GraphVariable(lua_State* L)
+{
+	BuildGraph*   graph = CheckGraph(L);
+	std::uint32_t edge  = CheckEdge(L, graph, 2);
+	std::size_t   size;
+	const char*   name = luaL_checklstring(L, 3, &size);
+	std::uint32_t id   = PoolFind(graph->strings, std::string_view(name, size));
+	if (id == c_None)
+		return 0;
+	for (std::uint32_t i = graph->edgeVariableStart[edge]; i < graph->edgeVariableStart[edge + 1]; i += 2)
+	{
+		if (graph->variables[i] == id)
+		{
+			PushString(L, graph->strings, graph->variables[i + 1]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int GraphDefaults(lua_State* L)
+{
+	BuildGraph* graph = CheckGraph(L);
+	PushIds(L, graph->defaults, 0, static_cast<std::uint32_t>(graph->defaults.size()));
+	return 1;
+}
+
+void AddGraphLib(lua_State* L)
+{
+	luaL_newmetatable(L, c_GraphMetatable);
+	lua_pushcfunction(L, &GraphGC);
+	lua_setfield(L, -2, "__gc");
+	lua_createtable(L, 0, 14);
+	lua_pushcfunction(L, &GraphClose);
+	lua_setfield(L, -2, "close");
+	lua_pushcfunction(L, &GraphNodeCount);
+	lua_setfield(L, -2, "node_count");
+	lua_pushcfunction(L, &GraphEdgeCount);
+	lua_setfield(L, -2, "edge_count");
+	lua_pushcfunction(L, &GraphMemoryUsage);
+	lua_setfield(L, -2, "memory");
+	lua_pushcfunction(L, &GraphNode);
+	lua_setfield(L, -2, "node");
+	lua_pushcfunction(L, &GraphPath);
+	lua_setfield(L, -2, "path");
+	lua_pushcfunction(L, &GraphProducer);
+	lua_setfield(L, -2, "producer");
+	lua_pushcfunction(L, &GraphConsumers);
+	lua_setfield(L, -2, "consumers");
+	lua_pushcfunction(L, &GraphOutputs);
+	lua_setfield(L, -2, "outputs");
+	lua_pushcfunction(L, &GraphInputs);
+	lua_setfield(L, -2, "inputs");
+	lua_pushcfunction(L, &GraphRule);
+	lua_setfield(L, -2, "rule");
+	lua_pushcfunction(L, &GraphProject);
+	lua_setfield(L, -2, "project");
+	lua_pushcfunction(L, &GraphVariable);
+	lua_setfield(L, -2, "variable");
+	lua_pushcfunction(L, &GraphDefaults);
+	lua_setfield(L, -2, "defaults");
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+
+	lua_createtable(L, 0, 1);
+	lua_pushcfunction(L, &GraphLoad);
+	lua_setfield(L, -2, "load");
+	lua_setglobal(L, "graph");
+}
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include <lua.hpp>
+
+#include <Build.h>
+
+// Counts the entries of the table so the copy can be created with its final size instead of rehashing while it fills
+static void CountEntries(lua_State* L, int index, int& arraySize, int& hashSize)
+{
+	int total = 0;
+	lua_pushnil(L);
+	while (lua_next(L, index))
+	{
+		++total;
+		lua_pop(L, 1);
+	}
+
+	arraySize = static_cast<int>(lua_objlen(L, index));
+	if (arraySize > total)
+		arraySize = total;
+	hashSize = total - arraySize;
+}
+
+// Pushes a copy of the table at index, the copy shares the metatable of the original
+static void ShallowCopy(lua_State* L, int index)
+{
+	int arraySize, hashSize;
+	CountEntries(L, index, arraySize, hashSize);
+	lua_createtable(L, arraySize, hashSize);
+	int copy = lua_gettop(L);
+
+	lua_pushnil(L);
+	while (lua_next(L, index))
+	{
+		lua_pushvalue(L, -2);
+		lua_insert(L, -2);
+		lua_rawset(L, copy);
+	}
+
+	if (lua_getmetatable(L, index))
+		lua_setmetatable(L, copy);
+}
+
+// Pushes a copy of the value at index, copies is a table mapping already copied tables to their copy so cycles and shared tables are kept intact
+static void DeepCopy(lua_State* L, int index, int copies)
+{
+	if (lua_type(L, index) != LUA_TTABLE)
+	{
+		lua_pushvalue(L, index);
+		return;
+	}
+
+	lua_pushvalue(L, index);
+	lua_rawget(L, copies);
+	if (!lua_isnil(L, -1))
+		return;
+	lua_pop(L, 1);
+
+	luaL_checkstack(L, 6, "Table is nested too deeply to copy");
+
+	int arraySize, hashSize;
+	CountEntries(L, index, arraySize, hashSize);
+	lua_createtable(L, arraySize, hashSize);
+	int copy = lua_gettop(L);
+
+	lua_pushvalue(L, index);
+	lua_pushvalue(L, copy);
+	lua_rawset(L, copies);
+
+	lua_pushnil(L);
+	while (lua_next(L, index))
+	{
+		int value = lua_gettop(L);
+		DeepCopy(L, value - 1, copies);
+		DeepCopy(L, value, copies);
+		lua_rawset(L, copy);
+		lua_pop(L, 1);
+	}
+
+	if (lua_getmetatable(L, index))
+		lua_setmetatable(L, copy);
+}
+
+static int TableShallowCopy(lua_State* L)
+{
+	if (!lua_istable(L, 1))
+	{
+		lua_settop(L, 1);
+		return 1;
+	}
+
+	ShallowCopy(L, 1);
+	return 1;
+}
+
+static int TableDeepCopy(lua_State* L)
+{
+	if (!lua_istable(L, 1))
+	{
+		lua_settop(L, 1);
+		return 1;
+	}
+
+	lua_settop(L, 1);
+	lua_newtable(L);
+	DeepCopy(L, 1, 2);
+	return 1;
+}
+
+// merge(destination[, source]), a nil source merges nothing
+static int TableMerge(lua_State* L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	if (lua_isnoneornil(L, 2))
+	{
+		lua_settop(L, 1);
+		return 1;
+	}
+	luaL_checktype(L, 2, LUA_TTABLE);
+
+	lua_settop(L, 2);
+	lua_pushnil(L);
+	while (lua_next(L, 2))
+	{
+		lua_pushvalue(L, -2);
+		lua_insert(L, -2);
+		lua_rawset(L, 1);
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+void AddTableLib(lua_State* L)
+{
+	lua_getglobal(L, "table");
+	lua_pushcfunction(L, &TableShallowCopy);
+	lua_setfield(L, -2, "shallow_copy");
+	lua_pushcfunction(L, &TableDeepCopy);
+	lua_setfield(L, -2, "deep_copy");
+	lua_pushcfunction(L, &TableMerge);
+	lua_setfield(L, -2, "merge");
+	lua_pop(L, 1);
+}
\ No newline at end of file
@@ -22,4 +22,8 @@ workspace("MBuild")
 
 		pkgdeps({ "commonbuild", "backtrace", "luajit" })
 
+		filter("system:linux")
+			links({ "pthread" })
+		filter({})
+
 		common:addActions()
\ No newline at end of file